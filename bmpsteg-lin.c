@@ -1,10 +1,10 @@
 /*
    Using steganography to embed a file into an uncompressed
-   24-bit RGB bitmap file.  Version 1.1
+   24-bit RGB bitmap file.  Version 1.2
 
    obtain a copy: https://github.com/billchaison/bmpsteg
 
-   compiling: gcc -o ./bmpsteg-lin ./bmpsteg-lin.c
+   compiling: gcc -O2 -pthread -o ./bmpsteg-lin ./bmpsteg-lin.c -lm
 */
 /*---------------------------------------------------------------------------
  This program is released under the "BSD Modified" license.
@@ -39,12 +39,33 @@
 
 #pragma pack(2)
 
+#define _GNU_SOURCE // cpu sets and thread affinity for --pin.
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <strings.h>
+#include <pthread.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <limits.h>
+#include <ctype.h>
+#include <sys/random.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <signal.h>
+#include <sched.h>
+#include <spawn.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
 
 #define BUF_SIZE 8192 // enough to hold a scan line of about 2700 pixels wide.
 #define MIN_DATA 12 // 3 bytes used to encode file length lo (RGB 24-bit pixel),
@@ -58,6 +79,137 @@
 #define BI_RGB 0
 #define HDR_CHECKE_PASS 16
 #define HDR_CHECKD_PASS 15
+#define HOST_HDR_MAX 1024 // longest netpbm header read, comments included.
+#define EXT_VERSION 2 // a zero length in the first two pixels marks an extended header.
+#define EXT_HDR_MIN 10 // magic (2), version, header length, flags (2) and body length (4).
+#define EXT_FLAG_ARCHIVE 0x0001 // body is an archive index followed by the member data.
+#define EXT_FLAG_SHARD 0x0002 // body is one shard of a payload split across covers.
+#define EXT_FLAG_CRC 0x0004 // header holds the crc32c of the body.
+#define EXT_FLAG_CHACHA 0x0008 // body is encrypted with ChaCha20, header holds the nonce.
+#define EXT_FLAG_LZ 0x0010 // body is LZ compressed, header holds the decompressed length.
+#define EXT_FLAG_FEC 0x0020 // body carries Reed-Solomon parity, header holds the code shape.
+#define EXT_FLAG_PERM 0x0040 // body bytes are placed in keyed order, header holds the planned length.
+#define EXT_FLAG_ADAPT 0x0080 // body pixels carry 0 to 8 bits by local texture, see adaptclass().
+#define EXT_FLAGS_KNOWN (EXT_FLAG_ARCHIVE | EXT_FLAG_SHARD | EXT_FLAG_CRC | EXT_FLAG_CHACHA | EXT_FLAG_LZ | EXT_FLAG_FEC | EXT_FLAG_PERM | EXT_FLAG_ADAPT)
+#define EXT_SHARD_LEN 24 // set id (4), sequence (2), total shards (2), offset (8) and payload length (8).
+#define EXT_CRC_LEN 4
+#define EXT_NONCE_LEN 12
+#define EXT_LZ_LEN 4
+#define EXT_FEC_LEN 2 // parity symbols per codeword and interleave depth.
+#define EXT_PERM_LEN 4
+#define LZ_BLOCK 65536 // bytes compressed at a time, keeps every offset within 16 bits.
+#define LZ_BOUND(n) ((n) + ((n) / 255) + 16) // worst case compressed size of n bytes.
+#define LZ_STORED 0x80000000 // block size flag, block did not compress and is stored.
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+#define LZ_HASH (1 << LZ_HASH_BITS)
+#define FEC_N 255 // RS codeword length over GF(2^8).
+#define FEC_MIN_PARITY 2
+#define FEC_MAX_PARITY 64 // corrects up to 32 bytes per codeword.
+#define FEC_DEPTH 240 // most codewords interleaved in one stripe.
+#define PERM_TILE 4096 // pixels permuted among themselves, 12 KiB of scan lines.
+#define PERM_BAND 262144 // pixels whose tiles are permuted, bounds the buffers.
+#define PERM_COUNTER 0xffffffff // keystream block giving the permutation keys.
+#define ADAPT_FLAT 2 // texture range up to which a pixel carries no bits.
+#define ADAPT_LOW 5 // up to which it carries 3 bits, 1-1-1.
+#define ADAPT_MID 9 // up to which it carries 5 bits, 2-1-2, and 8 bits above.
+#define CRC_LANES_MIN 3072 // shortest buffer worth splitting into three crc lanes.
+#define MAX_SHARDS 65535 // shard sequence is stored in 16 bits.
+#define PROBE_INVALID 0 // probe verdicts, header check failed.
+#define PROBE_CLEAN 1 // length prefix impossible for the image.
+#define PROBE_POSSIBLE 2 // version 1.1 length prefix fits the image.
+#define PROBE_PAYLOAD 3 // extended header found.
+#define PROBE_QUEUE 4096 // paths queued ahead of the probe workers.
+#define BULK_BUFFER 67108864 // decoded payload bytes held ahead of the tar writer, see bulkput().
+#define BULK_RECORDS 4096 // decoded covers held ahead of the tar writer.
+#define TAR_BLOCK 512
+#define MEM_STACK 262144 // worker thread stack under --mem-limit, deepest frames hold a few scan lines.
+#define MEM_RESERVE 4194304 // libc, stdio, queues and the main thread, kept out of --mem-limit.
+#define HUGE_PAGE 2097152 // huge page size on x86-64 and arm64, see bigalloc().
+#define HUGE_HDR 64 // length of the block kept in front of a bigalloc() buffer.
+#define CKPT_BYTES 67108864 // output written between --resume checkpoints, see ckptsave().
+#define CKPT_ID 84 // mode and input identities in a checkpoint, see ckptid().
+#define CKPT_LEN 148
+#define ANALYZE_INVALID 0 // analyze verdicts, header check failed.
+#define ANALYZE_CLEAN 1
+#define ANALYZE_SUSPECT 2 // a channel scores ANALYZE_SUSPECT_AT or more.
+#define ANALYZE_SUSPECT_AT 0.1 // estimated fraction of pixels with embedded LSBs.
+#define ANALYZE_CHI_MIN 4 // least expected count of a chi-square category.
+#define ROW_SIMD_MIN 16 // shorter runs of pixels take the scalar kernel.
+#define KERNEL_TEST_ROUNDS 100000 // scan lines compared by kernels test.
+#define KERNEL_BENCH_PIXELS (1 << 24) // pixels timed per case by kernels bench.
+#define KERNEL_BENCH_MIN 0.001 // seconds a timed pass takes at least, scan lines are added to reach it.
+#define KERNEL_BENCH_RUNS 5 // timed passes per case, the fastest is reported.
+#define COVER_CACHE_HDR 144 // sidecar magic, headers, identity of <bmp in> and HDRCHECK, see cachebuild().
+#define STAT_SETUP 0 // --stats phases, opening files and buffers.
+#define STAT_HEADER 1 // reading and checking the bitmap headers.
+#define STAT_COVER 2 // reading scan lines of <bmp in>.
+#define STAT_PAYLOAD 3 // reading, compressing and encrypting the payload, or the reverse.
+#define STAT_TRANSFORM 4 // embedding or extracting payload bits.
+#define STAT_FILL 5 // filling pixels past the payload.
+#define STAT_WRITE 6 // writing <bmp out> or <data out>.
+#define STAT_FINISH 7 // patching the extended header and closing files.
+#define STAT_PHASES 8
+#define STAT_SAMPLE 1024 // laps per cpu clock sample window, see statlap().
+#define STAT_WINDOW 16 // laps in each window.
+#define VERIFY_OK 0 // verify verdicts, body matches its crc32c.
+#define VERIFY_CORRUPT 1 // body does not match.
+#define VERIFY_NOCRC 2 // payload carries no crc32c.
+#define VERIFY_INVALID 3 // no readable payload.
+#define VERIFY_NOKEY 4 // body is encrypted and no key was given.
+#define MAX_MEMBERS 65535 // member count is stored in 16 bits.
+#define MAX_MEMBER_NAME 255 // member name length is stored in 8 bits.
+#define IDX_ENTRY_FIXED 13 // name length, offset (4), length (4) and crc (4).
+#define DEC_ARCHIVE -100 // decode() found an archive, use list or extract.
+#define DEC_SHARD -101 // decode() found one shard of a split payload, use join.
+#define DEC_CRC -102 // decoded body does not match the crc32c in the header.
+#define DEC_KEY -103 // body is encrypted and no key was given.
+#define DEC_FEC -104 // too many damaged bytes in a codeword to correct.
+
+// USDT probes for bpftrace and perf, provider bmpsteg.  Each site is a nop
+// with a .note.stapsdt entry giving the size and location of each
+// argument, the layout of <sys/sdt.h>, so a probe nobody attaches to costs
+// the nop.  Arguments are integers, pointers go as uintptr_t.
+//  job_start(op, <bmp in>), job_end(op, code), error(op, code).
+//  header(nValid, dwFlags, width, height) after each header check.
+//  row_read(row, bytes), row_transform(row, pixels), row_write(row, bytes).
+//  fill(row, pixel, nRF) where e runs out of payload, data_write(bytes) in d.
+#if defined(__x86_64__) && defined(__ELF__)
+#define USDT(name, args, ...) \
+	__asm__ __volatile__("990: nop\n" \
+		".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+		".balign 4\n" \
+		".4byte 992f-991f, 994f-993f, 3\n" \
+		"991: .asciz \"stapsdt\"\n" \
+		"992: .balign 4\n" \
+		"993: .8byte 990b\n" \
+		".8byte _.stapsdt.base\n" \
+		".8byte 0\n" \
+		".asciz \"bmpsteg\"\n" \
+		".asciz \"" #name "\"\n" \
+		".asciz \"" args "\"\n" \
+		"994: .balign 4\n" \
+		".popsection\n" \
+		".ifndef _.stapsdt.base\n" \
+		".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+		".weak _.stapsdt.base\n" \
+		".hidden _.stapsdt.base\n" \
+		"_.stapsdt.base: .space 1\n" \
+		".size _.stapsdt.base, 1\n" \
+		".popsection\n" \
+		".endif\n" :: __VA_ARGS__)
+// size operand printed negated by %n, negative for a signed argument.
+#define USDT_ARG(n, x) [s##n] "n" ((((__typeof__(x))-1) < 1 ? 1 : -1) * (int)sizeof(x)), [a##n] "nor" (x)
+#define PROBE1(name, a) USDT(name, "%n[s1]@%[a1]", USDT_ARG(1, a))
+#define PROBE2(name, a, b) USDT(name, "%n[s1]@%[a1] %n[s2]@%[a2]", USDT_ARG(1, a), USDT_ARG(2, b))
+#define PROBE3(name, a, b, c) USDT(name, "%n[s1]@%[a1] %n[s2]@%[a2] %n[s3]@%[a3]", USDT_ARG(1, a), USDT_ARG(2, b), USDT_ARG(3, c))
+#define PROBE4(name, a, b, c, d) USDT(name, "%n[s1]@%[a1] %n[s2]@%[a2] %n[s3]@%[a3] %n[s4]@%[a4]", USDT_ARG(1, a), USDT_ARG(2, b), USDT_ARG(3, c), USDT_ARG(4, d))
+#else
+#define PROBE1(name, a) ((void)0)
+#define PROBE2(name, a, b) ((void)0)
+#define PROBE3(name, a, b, c) ((void)0)
+#define PROBE4(name, a, b, c, d) ((void)0)
+#endif
 
 // BMP file header taken from MSDN.
 typedef struct tagBITMAPFILEHEADER
@@ -93,54 +245,631 @@ typedef struct hdrCheck
 	int nBMPdlen;
 	int nStride;
 	int nPadding; // not used when output based on a source BMP.
+	int nOffset; // bytes ahead of the first scan line, copied as they are by e.
 	uint32_t dwFlags;
 } HDRCHECK, *PHDRCHECK;
 
+// options given ahead of the mode.
+typedef struct options
+{
+	int bCRC; // --crc, e writes an extended header with a crc32c of <data in>.
+	int bHaskey; // --key-file or --key-env, bodies are encrypted and decrypted.
+	int bLZ; // --lz, e compresses <data in>.
+	int nFec; // --fec, parity symbols per codeword for e, 0 for none.
+	int bPerm; // --perm, e places body bytes in keyed order.
+	int bAdapt; // --adaptive, e embeds fewer bits in flat areas.
+	int bStats; // --stats, e and d print a JSON record of phase timings.
+	char *pCache; // --cache, directory of masked covers for e.
+	int nRaww; // --raw, width and height of a headerless BGR cover, 0 for none.
+	int nRawh;
+	int nGenw; // --generate, width and height of the cover e makes, 0 for none.
+	int nGenh;
+	uint64_t qwMemlimit; // --mem-limit, bytes of heap and stacks, 0 for none.
+	int bHuge; // --hugepages, band buffers and cache mappings on huge pages.
+	int bPin; // --pin, each worker bound to a cpu, NUMA nodes taken in turn.
+	int bResume; // --resume, e and d keep a checkpoint and pick up from it.
+	uint8_t bKey[32];
+} OPTIONS, *POPTIONS;
+
+// ChaCha20 key and nonce, see chachainit().
+typedef struct cipher
+{
+	uint32_t dwState[16];
+} CIPHER, *PCIPHER;
+
+// extended payload header, follows a zero length in the first two pixels.
+typedef struct extHdr
+{
+	int nHdrlen; // bytes of extended header, 0 for a version 1.1 payload.
+	uint16_t wFlags;
+	uint32_t dwLength; // bytes of body following the header.
+	uint32_t dwSetid; // EXT_FLAG_SHARD fields, identifies covers split from one payload.
+	uint16_t wSeq;
+	uint16_t wShards;
+	uint64_t qwOffset; // offset of this shard in the payload.
+	uint64_t qwTotal; // length of the whole payload.
+	uint32_t dwCRC; // EXT_FLAG_CRC field, crc32c of the body.
+	uint8_t bNonce[EXT_NONCE_LEN]; // EXT_FLAG_CHACHA field.
+	uint32_t dwRaw; // EXT_FLAG_LZ field, decompressed length of the body.
+	int nFecparity; // EXT_FLAG_FEC field, parity symbols per codeword.
+	int nFecdepth; // EXT_FLAG_FEC field, codewords interleaved in a stripe.
+	uint32_t dwData; // body length without parity.
+	uint32_t dwPlan; // EXT_FLAG_PERM field, body length the slots were planned for.
+	uint8_t bRaw[256]; // header as embedded.
+} EXTHDR, *PEXTHDR;
+
+// a file carried in the payload, either <data in> or an archive member.
+typedef struct member
+{
+	char szName[MAX_MEMBER_NAME + 1]; // name stored in the archive index.
+	char *pPath; // opened when reading starts if fIn is NULL.
+	FILE *fIn;
+	uint32_t dwOffset; // offset of the member data from the start of the body.
+	uint32_t dwLength;
+	uint32_t dwCRC; // crc32c of the member data.
+} MEMBER, *PMEMBER;
+
+// compression stage of a payload stream, see lzread().
+typedef struct lzStream
+{
+	uint8_t bRaw[LZ_BLOCK];
+	uint8_t bOut[4 + LZ_BOUND(LZ_BLOCK)]; // block size and compressed block.
+	uint16_t wHash[LZ_HASH]; // last block offset of each hashed 4 bytes.
+	int nOut; // bytes in bOut.
+	int nPos; // bytes of bOut already read.
+} LZSTREAM, *PLZSTREAM;
+
+// interleaved Reed-Solomon coder, see fecencode() and fecdecode().
+typedef struct fecCoder
+{
+	int nParity; // parity symbols per codeword.
+	int nDepth; // codewords interleaved in a stripe.
+	uint8_t bGen[FEC_MAX_PARITY][32]; // gftable() of each generator coefficient.
+	uint8_t bSyn[FEC_MAX_PARITY][32]; // gftable() of each generator root.
+	uint8_t *pData; // stripe data rows, followed by the parity rows when encoding.
+	uint8_t *pPar; // parity rows.
+	uint8_t *pWork; // feedback row or syndrome rows.
+	int nOut; // stripe bytes in pData.
+	int nPos; // bytes of pData already read.
+	uint64_t qwBody; // body bytes before this stripe.
+	int bFailed; // a codeword could not be corrected.
+	int nFixed; // bytes corrected.
+} FECCODER, *PFECCODER;
+
+// keyed placement of body bytes, see permsrc() and pxperm().
+typedef struct permStream
+{
+	uint32_t dwKey[4]; // permute() round keys.
+	uint64_t qwRegion; // pixels from the first body pixel to the end of the image.
+	uint64_t qwPlan; // body bytes spread over the region.
+	uint64_t qwNext; // first region pixel of the band.
+	uint64_t qwOut; // body bytes gathered so far.
+	uint32_t dwBand; // band number.
+	int nBand; // pixels in the band.
+	int nSlots; // body bytes planned for the band.
+	int nPos; // pixels returned, or slots gathered.
+	int nTile; // tile cached by permslot().
+	int nTilebase; // first band pixel of the tile.
+	int nTilesize;
+	int nTilefirst; // first slot in the tile.
+	int nTilenext; // first slot in the next tile.
+	uint8_t bIn[PERM_BAND]; // band body bytes in stream order.
+	uint8_t bSlot[PERM_BAND]; // band body bytes in pixel order.
+	uint8_t bUsed[PERM_BAND]; // pixel holds a body byte.
+} PERMSTREAM, *PPERMSTREAM;
+
+// texture classes of a scan line from a window of three, see adaptclass().
+typedef struct adaptMap
+{
+	int nW; // pixels per scan line.
+	int nRows; // scan lines seen since the window was empty.
+	int nRow; // scan line classified by pxadaptrow(), -1 for none.
+	uint8_t *pG[3]; // texture values of the last three scan lines, oldest first.
+	uint8_t *pMax; // column max and min over the window, an edge pixel either side.
+	uint8_t *pMin;
+	uint8_t *pClass; // class of each pixel of the newest scan line, 0 to 3.
+	uint32_t dwAcc; // body bits not yet embedded or returned.
+	int nAcc;
+	uint64_t qwOut; // body bytes returned by pxadapt().
+} ADAPTMAP, *PADAPTMAP;
+
+// --cache sidecar of one cover mapped for encode(), see cacheopen().
+typedef struct coverCache
+{
+	uint8_t *pMap;
+	size_t nMap;
+	uint8_t *pRows; // scan lines with the embedding bits cleared, padding as is.
+	uint8_t *pLow; // the cleared bits, one byte per pixel as extractrow() gives them.
+	HDRCHECK hc; // validateheader() of <bmp in> for an empty payload.
+} COVERCACHE, *PCOVERCACHE;
+
+// cover made up by encode() in place of <bmp in>, see genrow().
+typedef struct genCover
+{
+	uint64_t qwState; // noise generator, one step per pixel in scan line order.
+	int nW;
+	int nH;
+	int nStride;
+} GENCOVER, *PGENCOVER;
+
+// progress of an e or d run under --resume, kept in <out>.ckpt, see ckptsave().
+typedef struct checkpoint
+{
+	char szPath[PATH_MAX + 16];
+	FILE *fOut; // the output being checkpointed.
+	uint8_t bId[CKPT_ID];
+	uint16_t wFlags; // e: extended header flags and nonce of the run.
+	uint8_t bNonce[EXT_NONCE_LEN];
+	int bDone; // e: the payload has ended, later scan lines are filled.
+	int nRow; // e: scan lines written.
+	uint64_t qwPos; // e: payload stream bytes read, d: <data out> bytes written.
+	uint32_t dwCRC; // e: crc32c of <data in> read, d: of <data out> written.
+	uint64_t qwGen; // e: --generate noise state.
+	uint64_t qwBlock; // output offset of the bytes written since the last save.
+	uint32_t dwBlock;
+	uint32_t dwBlockcrc;
+	int bSaved; // this run has saved a checkpoint.
+} CHECKPOINT, *PCHECKPOINT;
+
+// payload byte stream fed to encode(), a prefix followed by whole files.
+typedef struct dataSrc
+{
+	uint8_t *pPrefix; // headers built in memory.
+	int nPrefix;
+	int nPos; // read position in pPrefix.
+	PMEMBER pMembers;
+	int nMembers;
+	int nMember; // member currently being read.
+	uint32_t dwLeft; // bytes still expected from the current member.
+	int bCipher; // encrypt the body with ci, see srccipher().
+	CIPHER ci;
+	int nHdr; // leading bytes not encrypted.
+	uint64_t qwPos; // bytes read so far.
+	PLZSTREAM pLz; // compresses member data when not NULL.
+	uint64_t qwBody; // body bytes read so far.
+	PFECCODER pFec; // adds parity to the body when not NULL.
+	uint64_t qwCoded; // body bytes embedded so far.
+	PPERMSTREAM pPerm; // places body bytes when not NULL.
+	uint8_t *pMask; // with pPerm, flags the bytes from readsrc() to embed.
+	PADAPTMAP pAdapt; // embeds body bits by texture when not NULL.
+	PCOVERCACHE pCover; // scan lines come from a --cache sidecar when not NULL.
+	PGENCOVER pGen; // scan lines are generated when not NULL.
+	PCHECKPOINT pCkpt; // saved every CKPT_BYTES of <bmp out> when not NULL.
+	int nRow0; // first scan line to encode, past those a checkpoint holds.
+} DATASRC, *PDATASRC;
+
+// one cover of a split or join, run on a worker thread.
+typedef struct shardJob
+{
+	char *pBMPin;
+	char *pFileout; // <bmp out> for split, <data out> for join.
+	char *pDatain; // payload read by split.
+	FILE *fBMPin;
+	off_t lData; // offset of the image data in fBMPin.
+	char pBMPbufhdrin[sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER)];
+	HDRCHECK hc;
+	EXTHDR eh;
+	int nRF;
+	int nErr; // non zero when the job failed.
+} SHARDJOB, *PSHARDJOB;
+
+// jobs shared out to worker threads by runpool().
+typedef struct workPool
+{
+	int (*pfnJob)(void *pCtx, int i);
+	void *pCtx;
+	int nJobs;
+	int nNext; // next job to hand out.
+	int nFailed;
+} WORKPOOL, *PWORKPOOL;
+
+// bounded queue of paths from the directory walk to the workers.
+typedef struct pathQueue
+{
+	char **ppPaths;
+	int nCap;
+	int nHead;
+	int nCount;
+	int bDone; // walk finished, workers exit once the queue is empty.
+	pthread_mutex_t mtx;
+	pthread_cond_t cvPut;
+	pthread_cond_t cvGet;
+} PATHQUEUE, *PPATHQUEUE;
+
+typedef struct probeCtx
+{
+	PATHQUEUE q;
+	int nCount[PROBE_PAYLOAD + 1]; // files per verdict.
+} PROBECTX, *PPROBECTX;
+
+// spool directory served by cmdwatch(), one job per completed file.
+typedef struct watchCtx
+{
+	PATHQUEUE q; // file names in pSpool.
+	char *pArgv0;
+	char **ppOpts; // global options main() was given, passed on to each job.
+	int nOpts;
+	char *pMode; // "e" or "d".
+	char *pSpool;
+	char *pDone;
+	char *pBMPin; // cover for e.
+	char *pFill;
+	int nDone;
+	int nFailed;
+} WATCHCTX, *PWATCHCTX;
+
+// one decoded cover waiting for the tar writer.
+typedef struct bulkRec
+{
+	char *pPath;
+	char *pData; // payload, from open_memstream().
+	size_t nData;
+	time_t tMtime; // of the cover.
+	uint64_t qwSeq; // order the path was queued in.
+	int e; // 0 or why the cover was skipped.
+} BULKREC, *PBULKREC;
+
+// covers decoded by cmdbulk() workers into one tar stream.
+typedef struct bulkCtx
+{
+	PATHQUEUE q;
+	PATHQUEUE qWalk; // walked paths for sorting with -s.
+	char **ppSorted;
+	int nSorted;
+	int nSortcap;
+	pthread_mutex_t mtxSeq; // pairs each qget() with its sequence.
+	pthread_mutex_t mtx; // guards the ring and counts below.
+	pthread_cond_t cvPut;
+	pthread_cond_t cvGet;
+	PBULKREC *ppRing; // slot qwSeq % BULK_RECORDS.
+	uint64_t qwSeq; // next path sequence handed out.
+	uint64_t qwIn; // next slot taken without -s.
+	uint64_t qwNext; // next slot the writer takes.
+	size_t nHeld; // payload bytes in the ring.
+	size_t nLimit;
+	FILE *fOut;
+	int bSorted;
+	int nRunning; // workers not yet done.
+	int nDone;
+	int nSkipped;
+	int bFailed; // the tar stream could not be written.
+} BULKCTX, *PBULKCTX;
+
+// LSB plane statistics of one channel, see lsbrow().
+typedef struct lsbStats
+{
+	uint64_t qwHist[2][256]; // value histogram, even and odd pixels.
+	uint64_t qwX; // sample pairs by class, the rest are Y, see lsbspa().
+	uint64_t qwW;
+	uint64_t qwZ;
+	uint64_t qwPairs;
+	uint64_t qwR[4]; // regular and singular RS groups under the flips +1, -1,
+	uint64_t qwS[4]; // then +1, -1 with every LSB flipped.
+	uint64_t qwGroups;
+} LSBSTATS, *PLSBSTATS;
+
+typedef struct analyzeCtx
+{
+	PATHQUEUE q;
+	int nCount[ANALYZE_SUSPECT + 1]; // files per verdict.
+} ANALYZECTX, *PANALYZECTX;
+
+// embedrow() and extractrow() implementation, see rowinit().
+typedef struct rowKernel
+{
+	const char *pName;
+	void (*pfnEmbed)(uint8_t *pC, const uint8_t *pData, int n);
+	void (*pfnExtract)(const uint8_t *pC, uint8_t *pData, int n);
+	int (*pfnUsable)(void); // the cpu runs it.
+} ROWKERNEL, *PROWKERNEL;
+
+// synthetic cover shape timed by bench.
+typedef struct benchCover
+{
+	const char *pName;
+	int nW;
+	int nH;
+	int bFull; // only in the full suite.
+} BENCHCOVER, *PBENCHCOVER;
+
+// one timed run of main(), see benchrun().
+typedef struct benchResult
+{
+	double dWall; // seconds.
+	double dUser;
+	double dSys;
+	long lMaxrss; // peak resident set in KiB.
+	uint64_t qwReads; // read and write system calls.
+	uint64_t qwWrites;
+	int nExit;
+} BENCHRESULT, *PBENCHRESULT;
+
+// --stats timers and counters for one e or d job, see statlap().
+typedef struct stats
+{
+	int bOn;
+	struct timespec tStart; // monotonic clock, scales ticks to seconds.
+	uint64_t qwStart; // statclock() at statstart().
+	uint64_t qwLast; // statclock() at the last lap.
+	uint64_t qwLaps;
+	uint64_t qwTicks[STAT_PHASES];
+	uint64_t qwCalls[STAT_PHASES];
+	uint64_t qwBytes[STAT_PHASES];
+	int bCpu; // the thread cpu clock was read at the last lap.
+	int nUnsampled; // phases run but without a sampled lap yet.
+	uint64_t qwCputick; // statclock() and cpu clock at that read.
+	uint64_t qwCpuns;
+	uint64_t qwSampleticks[STAT_PHASES]; // ticks of the sampled laps and
+	uint64_t qwSamplens[STAT_PHASES]; // the cpu nanoseconds spent in them.
+} STATS, *PSTATS;
+
+// one <bmp in> checked by verify.
+typedef struct verifyJob
+{
+	char *pBMPin;
+	int nResult; // VERIFY_ verdict.
+	uint32_t dwLength;
+	uint32_t dwCRC; // crc32c of the body as decoded.
+} VERIFYJOB, *PVERIFYJOB;
+
+// sequential or seeking pixel reader used to extract payload bytes.
+typedef struct pixReader
+{
+	FILE *fBMPin;
+	HDRCHECK hc;
+	uint8_t *pRow; // scan line buffer.
+	off_t lData; // offset of the image data in fBMPin.
+	int nLoaded; // scan line held in pRow, -1 when none.
+	int nRow; // scan line of the next pixel.
+	int nCol; // column of the next pixel.
+	int bCipher; // decrypt the body with ci, see pxcipher().
+	CIPHER ci;
+	uint32_t dwBody; // first body pixel.
+	int nFecparity; // body carries parity, see pxfec().
+	int nFecdepth;
+	uint32_t dwFecleft; // embedded body bytes not yet read.
+	PFECCODER pFec; // allocated on first use.
+	int bPerm; // body bytes are placed in keyed order, see pxperm().
+	uint32_t dwPlan;
+	PPERMSTREAM pPerm; // allocated on first use.
+	int bAdapt; // body bits follow the texture, see pxadapt().
+	PADAPTMAP pAdapt; // allocated on first use.
+	PCHECKPOINT pCkpt; // pxcopy() output saved every CKPT_BYTES when not NULL.
+} PIXRDR, *PPIXRDR;
+
 int usage(void);
 uint8_t endian(void);
-HDRCHECK validateheadere(void *p, int i, int j);
-HDRCHECK validateheaderd(void *p, int i);
-int encode(FILE *fBMPin, FILE *fDatain, FILE *fFileout, char *pBMPbufin, char *pDatabufin, HDRCHECK hc, int nFS2, int nRF);
-int decode(FILE *fBMPin, FILE *fFileout, char *pBMPbufin, HDRCHECK hc);
+HDRCHECK validateheader(void *p, int i, int j, int bDecode);
+char *pnmword(char *s, char *pEnd, char *pWord, int nWord);
+HDRCHECK pnmcheck(void *p, int nHdr, int i, int j, int bDecode);
+HDRCHECK rawcheck(int i, int j, int bDecode);
+HDRCHECK hostcheck(void *p, int nHdr, int i, int j, int bDecode);
+int readhost(FILE *fBMPin, char *pBMPbufhdrin, int nFS1);
+int encode(FILE *fBMPin, FILE *fFileout, char *pBMPbufin, char *pDatabufin, HDRCHECK hc, PDATASRC ds, int nRF);
+int decode(FILE *fBMPin, FILE *fFileout, char *pBMPbufin, HDRCHECK hc, PCHECKPOINT pCkpt);
+int fillmode(char *p);
+void crc32cinit(void);
+uint32_t crc32c(uint32_t dwCRC, const uint8_t *p, size_t n);
+uint32_t crc32csw(uint32_t c, const uint8_t *p, size_t n);
+#if defined(__x86_64__)
+uint32_t crc32chw(uint32_t c, const uint8_t *p, size_t n);
+#endif
+uint32_t multmodp(uint32_t a, uint32_t b);
+uint32_t crc32cx8n(uint64_t n);
+uint32_t crc32ccombine(uint32_t dwCRC1, uint32_t dwCRC2, uint64_t n2);
+uint32_t bodycrc(PDATASRC ds, int nHdr);
+int patchhdr(FILE *fFileout, HDRCHECK hc, PEXTHDR eh, PDATASRC ds, uint8_t *pRow);
+void embedrow(uint8_t *pC, const uint8_t *pData, int n);
+void extractrow(const uint8_t *pC, uint8_t *pData, int n);
+void embedrowsw(uint8_t *pC, const uint8_t *pData, int n);
+void extractrowsw(const uint8_t *pC, uint8_t *pData, int n);
+void rowinit(void);
+#if defined(__x86_64__)
+int hasssse3(void);
+void embedrowssse3(uint8_t *pC, const uint8_t *pData, int n);
+void extractrowssse3(const uint8_t *pC, uint8_t *pData, int n);
+#endif
+int hasscalar(void);
+void fillrow(uint8_t *pC, int n, int nRF);
+uint8_t fillbyte(int nRF);
+void initsrc(PDATASRC ds, uint8_t *pPrefix, int nPrefix, PMEMBER pMembers, int nMembers);
+int readsrc(PDATASRC ds, uint8_t *p, int n);
+int readbody(PDATASRC ds, uint8_t *p, int n);
+int readmembers(PDATASRC ds, uint8_t *p, int n);
+void closesrc(PDATASRC ds);
+void pxinit(PPIXRDR pr, FILE *fBMPin, char *pBMPbufin, HDRCHECK hc);
+int pxload(PPIXRDR pr, int nRow);
+int pxseek(PPIXRDR pr, uint32_t dwPixel);
+int pxread(PPIXRDR pr, uint8_t *p, int n);
+int pxextract(PPIXRDR pr, uint8_t *p, int n);
+int pxraw(PPIXRDR pr, uint8_t *p, int n);
+void pxclose(PPIXRDR pr);
+int pxcopy(PPIXRDR pr, uint32_t dwLength, FILE *fFileout, uint32_t *pdwCRC);
+void putle(uint8_t *p, uint64_t v, int n);
+uint64_t getle(const uint8_t *p, int n);
+int putexthdr(PEXTHDR eh, uint8_t *p);
+int readpayloadhdr(PPIXRDR pr, PEXTHDR eh);
+int putindex(PMEMBER pMembers, int nMembers, uint8_t *p);
+int readindex(PPIXRDR pr, PEXTHDR eh, PMEMBER pm);
+int patchbytes(FILE *fFileout, HDRCHECK hc, uint32_t dwPixel, const uint8_t *p, uint32_t n, uint8_t *pRow);
+FILE *openbmp(char *pBMPin, char *pBMPbufhdrin, int *pnFS1);
+int cmpmember(const void *a, const void *b);
+int openarchive(char *pBMPin, FILE **pfBMPin, char **ppBMPbufin, PPIXRDR pr, PEXTHDR eh);
+int cmdpack(int argc, char **argv);
+int cmdlist(int argc, char **argv);
+int cmdextract(int argc, char **argv);
+void *poolworker(void *p);
+int runpool(int nJobs, uint64_t qwJob, int (*pfnJob)(void *pCtx, int i), void *pCtx);
+int splitjob(void *pCtx, int i);
+int joinjob(void *pCtx, int i);
+int cmdsplit(int argc, char **argv);
+int cmdjoin(int argc, char **argv);
+int probefile(char *pPath, uint32_t *pdwLength, uint32_t *pdwFlags);
+void qinit(PPATHQUEUE q, int nCap);
+void qput(PPATHQUEUE q, char *pPath);
+char *qget(PPATHQUEUE q);
+void qdone(PPATHQUEUE q);
+int isbmpname(char *pName);
+int walkpath(PPATHQUEUE q, char *pPath, int bTop);
+void *probeworker(void *p);
+int cmdprobe(int argc, char **argv);
+void chachainit(PCIPHER ci, const uint8_t *pKey, const uint8_t *pNonce);
+void chachablock(PCIPHER ci, uint32_t dwCounter, uint8_t *pOut);
+#if defined(__x86_64__)
+void chachaxor4(PCIPHER ci, uint32_t dwCounter, uint8_t *p);
+#endif
+void chacha20xor(PCIPHER ci, uint64_t qwOffset, uint8_t *p, size_t n);
+int loadkey(char *pKeyfile, char *pKeyenv);
+int newnonce(PEXTHDR eh);
+void srccipher(PDATASRC ds, PEXTHDR eh);
+int pxcipher(PPIXRDR pr, PEXTHDR eh);
+int lzcompress(const uint8_t *pIn, int n, uint8_t *pOut, uint16_t *pHash);
+uint8_t *lzputlen(uint8_t *op, int n);
+int lzdecompress(const uint8_t *pIn, int n, uint8_t *pOut, int nMax);
+int lzread(PDATASRC ds, uint8_t *p, int n);
+int lzcopy(PPIXRDR pr, PEXTHDR eh, FILE *fFileout, uint32_t *pdwCRC);
+void gfinit(void);
+uint8_t gfmul(uint8_t a, uint8_t b);
+uint8_t gfdiv(uint8_t a, uint8_t b);
+void gftable(uint8_t *pTbl, uint8_t c);
+void gfmacsw(const uint8_t *pTbl, uint8_t *pDst, const uint8_t *pMul, const uint8_t *pAdd, int n);
+#if defined(__x86_64__)
+void gfmacssse3(const uint8_t *pTbl, uint8_t *pDst, const uint8_t *pMul, const uint8_t *pAdd, int n);
+#endif
+PFECCODER fecnew(int nParity, int nDepth);
+void fecfree(PFECCODER f);
+uint64_t fecsize(uint64_t qwData, int nParity, int nDepth);
+int fecdepth(uint64_t qwData, int nParity);
+void fecencode(PFECCODER f, int nData);
+int fecdecode(PFECCODER f, int nData);
+int fecfix(PFECCODER f, int c, const uint8_t *syn, int nRows, int nData);
+int fecsrc(PDATASRC ds, uint8_t *p, int n);
+int pxfec(PPIXRDR pr, uint8_t *p, int n);
+uint32_t permute(const uint32_t *pKey, uint32_t x, uint32_t n, uint32_t dwTweak);
+PPERMSTREAM permnew(PCIPHER ci, uint32_t dwPlan, uint64_t qwRegion);
+void permband(PPERMSTREAM pp);
+uint32_t permslot(PPERMSTREAM pp, int j);
+int readcoded(PDATASRC ds, uint8_t *p, int n);
+int permsrc(PDATASRC ds, uint8_t *p, uint8_t *pMask, int n);
+void embedmasked(uint8_t *pC, const uint8_t *pData, const uint8_t *pMask, int n, int nRF);
+int pxperm(PPIXRDR pr, uint8_t *p, int n);
+void adaptinit(void);
+PADAPTMAP adaptnew(int nW);
+void adaptnext(PADAPTMAP am, const uint8_t *pC);
+void adaptclass(PADAPTMAP am);
+int adaptrow(PDATASRC ds, uint8_t *pC, uint8_t *pData, int nW, uint32_t dwPixel, int bDone, int nRF);
+int pxadaptrow(PPIXRDR pr);
+int pxadapt(PPIXRDR pr, uint8_t *p, int n);
+void lsbrow(PLSBSTATS ls, const uint8_t *pC, int nW);
+int lsbsmooth(int a, int b, int c, int d);
+double lsbroot(double a, double b, double c);
+double lsbchi(PLSBSTATS s);
+double lsbrs(PLSBSTATS s);
+double lsbspa(PLSBSTATS s);
+double gammaq(double a, double x);
+int analyzefile(char *pPath, double *pScore, double *pChi, double *pRS, double *pSPA, uint32_t *pdwFlags);
+void *analyzeworker(void *p);
+int cmdanalyze(int argc, char **argv);
+uint64_t benchrand(uint64_t *pState);
+void bmpheader(uint8_t *p, int nW, int nH);
+void genrow(PGENCOVER gc, int nRow, uint8_t *pRow);
+int benchcover(char *pPath, int nW, int nH);
+int benchpayload(char *pPath, uint64_t qwLength);
+int benchrun(char **ppArgs, int nArgs, PBENCHRESULT br);
+void benchprint(const BENCHCOVER *bc, double dRatio, uint64_t qwPayload, char *pOp, char cFill, char *pStatus, PBENCHRESULT br, uint64_t qwImage);
+int benchbest(char **ppArgs, int nArgs, int nRepeat, PBENCHRESULT br);
+int cmdbench(int argc, char **argv);
+int kerneltest(int nRounds);
+double kerneltime(int k, int bExtract, uint8_t *pCover, uint8_t *pData, int w, int nRows);
+void kernelbench(int nPixels);
+int cmdkernels(int argc, char **argv);
+int procio(uint64_t *pqwIO);
+uint64_t statclock(void);
+void statstart(void);
+void statcpu(int nPhase, uint64_t qwNow);
+void statlap(int nPhase, uint64_t qwBytes);
+void statreport(char *pOp, int nStatus);
+int cacheopen(FILE *fBMPin, int nFS1, char *pBMPbufhdrin, PCOVERCACHE cc);
+int cachebuild(FILE *fBMPin, char *pPath, struct stat *st);
+int cachemap(char *pPath, struct stat *st, PCOVERCACHE cc);
+HDRCHECK cachecheck(PCOVERCACHE cc, int j);
+void coverrow(PCOVERCACHE cc, int nRow, uint8_t *pRow, int bRestore);
+void cacheclose(PCOVERCACHE cc);
+int updatesrc(PDATASRC ds, PMEMBER m, PEXTHDR eh, uint8_t *pPrefix, int nPrefix);
+void updatefree(PDATASRC ds);
+int cmdupdate(int argc, char **argv);
+int verifyjob(void *pCtx, int i);
+int cmdverify(int argc, char **argv);
+uint64_t parsesize(char *p);
+int memlimit(void);
+uint64_t jobmem(uint16_t wFlags, int nW);
+int memthreads(int nThreads, uint64_t qwJob);
+pthread_attr_t *workerattr(void);
+void watchstop(int nSig);
+int pathfd(char *pPath, int nFlags);
+FILE *fopenpath(char *pPath, char *pMode);
+int statpath(char *pPath, struct stat *st);
+int removepath(char *pPath);
+int watchscan(PWATCHCTX wc);
+int watchjob(PWATCHCTX wc, char *pName);
+void *watchworker(void *p);
+int cmdwatch(int argc, char **argv);
+void tarheader(uint8_t *p, char *pName, uint64_t qwSize, time_t t, char cType);
+int tarwrite(FILE *f, uint8_t *pHdr, const char *pData, size_t n);
+int tarput(FILE *f, char *pName, const char *pData, size_t n, time_t t);
+int bulkdecode(PBULKREC r, char *pBMPbufhdrin, char *pBMPbufin);
+void bulkput(PBULKCTX bc, PBULKREC r);
+void *bulkworker(void *p);
+void *bulkwriter(void *p);
+void *bulkcollect(void *p);
+int cmppath(const void *a, const void *b);
+int cmdbulk(int argc, char **argv);
+void *bigalloc(size_t n);
+void bigfree(void *p);
+int pininit(void);
+void pinworker(void);
+void ckptid(PCHECKPOINT pc, int nPart, struct stat *st);
+int ckptload(PCHECKPOINT pc);
+int ckptsave(PCHECKPOINT pc);
+int ckptcheck(PCHECKPOINT pc, FILE *f, uint64_t qwEnd);
+int ckptsrc(PCHECKPOINT pc, PDATASRC ds);
+int ckptrow(PDATASRC ds, uint8_t *p, int n, int nRow, int bDone);
+int ckptdata(PCHECKPOINT pc, uint8_t *p, int n, uint32_t dwCRC);
+
+OPTIONS opts = { 0 };
+STATS stats = { 0 };
+pthread_attr_t attrworker; // small stacks under --mem-limit, see memlimit().
+volatile sig_atomic_t bWatchstop = 0; // SIGINT or SIGTERM while watching.
+uint64_t qwHugebytes = 0; // bytes bigalloc() has mapped for huge pages.
+int *pPincpus = NULL; // cpus in the order pinworker() hands them out, see pininit().
+int nPincpus = 0;
+int nPinnext = 0;
+char **ppOptwords = NULL; // argv as main() was first given it, see cmdwatch().
+int nOptwords = 0; // global option words in ppOptwords after argv[0].
 
 int main(int argc, char **argv)
 {
-	int nFS1, nFS2, nRF = 0, e;
+	int nFS1, nFS2, nRF = 0, e = 0, nOpt, bExt;
+	uint64_t qwPlan, qwRegion = 0;
+	uint16_t wMem;
 	char *pBMPin = NULL, *pFileout = NULL, *pDatain = NULL; // ASCIIZ file names.
 	char *pBMPbufhdrin = NULL, *pBMPbufin = NULL, *pDatabufin = NULL; // pointers to file contents.
-	FILE *fBMPin = NULL, *fDatain = NULL, *fFileout = NULL, *x = NULL;
+	FILE *fBMPin = NULL, *fDatain = NULL, *fFileout = NULL;
+	struct stat st;
 	HDRCHECK hc;
+	MEMBER m;
+	DATASRC ds;
+	EXTHDR eh;
+	COVERCACHE cc;
+	GENCOVER gc;
+	CHECKPOINT ck;
+	uint8_t pPrefix[FILE_SIZE_PIXELS + sizeof(eh.bRaw)];
+	int nPrefix = 0, nNeed, nHdr = 0, bCached = 0, bResumed = 0, ret = -1;
+	char **ppFirst = argv;
 
 	srand(time(NULL));
-	// test the input.
-	if(argc != 4 && argc != 6) { usage(); return -1; }
-	if((*argv[1] != 'e' && *argv[1] != 'd') || strlen(argv[1]) != 1) { usage(); return -1; }
-	if(*argv[1] == 'e' && argc != 6) { usage(); return -1; }
-	if(*argv[1] == 'd' && argc != 4) { usage(); return -1; }
-	if(*argv[1] == 'e')
-	{
-		if(!strcmp(argv[2], argv[3]) || !strcmp(argv[2], argv[4]) || !strcmp(argv[3], argv[4]))
-		{
-			fprintf(stderr, "ERROR: overlapping file names.\n");
-
-			return -1;
-		}
-		if((*argv[5] != 'r' && *argv[5] != 'n' && *argv[5] != 'd' && *argv[5] != 'l') || strlen(argv[5]) != 1)
-		{
-			usage();
-
-			return -1;
-		}
-	}
-	if(*argv[1] == 'd')
-	{
-		if(!strcmp(argv[2], argv[3]))
-		{
-			fprintf(stderr, "ERROR: overlapping file names.\n");
-
-			return -1;
-		}
-	}
+	// the option loop overwrites argv, watch passes the options on.
+	if(ppOptwords == NULL && (ppOptwords = (char **)malloc(argc * sizeof(char *))) != NULL) memcpy(ppOptwords, argv, argc * sizeof(char *));
 	// ensure the system is little-endian.
 	if(endian())
 	{
@@ -148,261 +877,434 @@ int main(int argc, char **argv)
 
 		return -1;
 	}
-	// test the input files.
-	if(*argv[1] == 'e')
+	// global options precede the mode.
+	while(argc > 1 && !strncmp(argv[1], "--", 2))
 	{
-		// prepare for encoding.
-		pBMPin = argv[2];
-		pFileout = argv[4];
-		pDatain = argv[3];
-		nFS1 = 0;
-		if((x = fopen(pBMPin, "rb")) != NULL)
+		nOpt = 1; // words taken by the option.
+		if(!strcmp(argv[1], "--crc")) opts.bCRC = 1;
+		else if(!strcmp(argv[1], "--lz")) opts.bLZ = 1;
+		else if(argc > 2 && !strcmp(argv[1], "--key-file")) { e = loadkey(argv[2], NULL); nOpt = 2; }
+		else if(argc > 2 && !strcmp(argv[1], "--key-env")) { e = loadkey(NULL, argv[2]); nOpt = 2; }
+		else if(argc > 2 && !strcmp(argv[1], "--fec")) { opts.nFec = atoi(argv[2]); nOpt = 2; }
+		else if(!strcmp(argv[1], "--perm")) opts.bPerm = 1;
+		else if(!strcmp(argv[1], "--adaptive")) opts.bAdapt = 1;
+		else if(!strcmp(argv[1], "--stats")) opts.bStats = 1;
+		else if(argc > 2 && !strcmp(argv[1], "--cache")) { opts.pCache = argv[2]; nOpt = 2; }
+		else if(argc > 2 && !strcmp(argv[1], "--raw"))
 		{
-			fseek(x, 0, SEEK_END);
-			nFS1 = ftell(x);
-			fclose(x);
+			if(sscanf(argv[2], "%dx%d", &opts.nRaww, &opts.nRawh) != 2 || opts.nRaww < 1 || opts.nRawh < 1) { usage(); return -1; }
+			nOpt = 2;
 		}
-		if(nFS1 < 1)
+		else if(argc > 2 && !strcmp(argv[1], "--mem-limit"))
 		{
-			fprintf(stderr, "ERROR: could not get size of <bmp in>.\n");
-
-			return -1;
+			if((opts.qwMemlimit = parsesize(argv[2])) == 0) { usage(); return -1; }
+			nOpt = 2;
 		}
-		nFS2 = 0;
-		if((x = fopen(pDatain, "rb")) != NULL)
+		else if(!strcmp(argv[1], "--hugepages")) opts.bHuge = 1;
+		else if(!strcmp(argv[1], "--pin")) opts.bPin = 1;
+		else if(!strcmp(argv[1], "--resume")) opts.bResume = 1;
+		else if(argc > 2 && !strcmp(argv[1], "--generate"))
 		{
-			fseek(x, 0, SEEK_END);
-			nFS2 = ftell(x);
-			fclose(x);
+			if(sscanf(argv[2], "%dx%d", &opts.nGenw, &opts.nGenh) != 2 || opts.nGenw < 1 || opts.nGenh < 1) { usage(); return -1; }
+			nOpt = 2;
 		}
-		if(nFS2 < 1)
+		else { usage(); return -1; }
+		if(e)
 		{
-			fprintf(stderr, "ERROR: could not get size of <data in>.\n");
+			fprintf(stderr, "ERROR: unable to read the key from %s, expected 32 bytes or 64 hex digits.\n", argv[2]);
 
 			return -1;
 		}
-		if(nFS1 * nFS2 == 0 || nFS1 < (sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + MIN_DATA) || nFS2 > MAX_DATA_FILE)
-		{
-			// either the BMP or data file is empty, the BMP file is too small to embed even 1 character, or the data file is too big.
-			fprintf(stderr, "ERROR: bad file size.\n");
+		if(opts.nFec && (opts.nFec < FEC_MIN_PARITY || opts.nFec > FEC_MAX_PARITY)) { usage(); return -1; }
+		argv[nOpt] = argv[0];
+		argv += nOpt;
+		argc -= nOpt;
+	}
+	if(nOptwords == 0) nOptwords = (int)(argv - ppFirst);
+	if(opts.bPerm && !opts.bHaskey)
+	{
+		fprintf(stderr, "ERROR: --perm needs --key-file or --key-env.\n");
 
-			return -1;
-		}
-		if((fBMPin = fopen(pBMPin, "rb")) == NULL)
-		{
-			fprintf(stderr, "ERROR: unable to open <bmp in>.\n");
+		return -1;
+	}
+	// a job needs room for the stages it is given, modes that decode
+	// covers of unknown stages for all of them.
+	wMem = (opts.bLZ ? EXT_FLAG_LZ : 0) | (opts.nFec ? EXT_FLAG_FEC : 0) | (opts.bPerm ? EXT_FLAG_PERM : 0) | (opts.bAdapt ? EXT_FLAG_ADAPT : 0);
+	if(argc > 1 && (!strcmp(argv[1], "d") || !strcmp(argv[1], "verify") || !strcmp(argv[1], "update") || !strcmp(argv[1], "bulk") || !strcmp(argv[1], "watch"))) wMem = 0xffff;
+	if(opts.qwMemlimit && opts.qwMemlimit < MEM_RESERVE + jobmem(wMem, 0))
+	{
+		fprintf(stderr, "ERROR: --mem-limit must be at least %" PRIu64 " bytes.\n", MEM_RESERVE + jobmem(wMem, 0));
 
-			return -1;
-		}
-		if((fDatain = fopen(pDatain, "rb")) == NULL)
-		{
-			fprintf(stderr, "ERROR: unable to open <data in>.\n");
-			fclose(fBMPin);
+		return -1;
+	}
+	if(opts.qwMemlimit && memlimit())
+	{
+		fprintf(stderr, "ERROR: unable to apply --mem-limit.\n");
 
-			return -1;
-		}
-		if((pBMPbufhdrin = (char *)malloc(sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER))) == NULL)
-		{
-			fprintf(stderr, "ERROR: unable to allocate buffer for <bmp in> header.\n");
-			fclose(fBMPin);
-			fclose(fDatain);
+		return -1;
+	}
+	if(opts.bPin && nPincpus == 0 && pininit())
+	{
+		fprintf(stderr, "ERROR: unable to read the cpus for --pin.\n");
 
-			return -1;
-		}
-		if((pBMPbufin = (char *)malloc(BUF_SIZE)) == NULL)
-		{
-			fprintf(stderr, "ERROR: unable to allocate buffer for <bmp in> data.\n");
-			fclose(fBMPin);
-			fclose(fDatain);
-			free(pBMPbufhdrin);
+		return -1;
+	}
+	if(opts.nGenw && opts.nRaww)
+	{
+		fprintf(stderr, "ERROR: --generate and --raw cannot be combined.\n");
 
-			return -1;
-		}
-		if(fread(pBMPbufhdrin, 1, sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER), fBMPin) != sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER))
-		{
-			fprintf(stderr, "ERROR: unable to read <bmp in> headers.\n");
-			fclose(fBMPin);
-			fclose(fDatain);
-			free(pBMPbufhdrin);
-			free(pBMPbufin);
+		return -1;
+	}
+	if(opts.bPerm && opts.bAdapt)
+	{
+		fprintf(stderr, "ERROR: --perm and --adaptive cannot be combined.\n");
 
-			return -1;
-		}
-		// sanity check the headers.
-		hc = validateheadere(pBMPbufhdrin, nFS1, nFS2);
-		if(hc.nValid != HDR_CHECKE_PASS)
-		{
-			fprintf(stderr, "ERROR: <bmp in> header check failed (%08X).\n", hc.dwFlags);
-			fclose(fBMPin);
-			fclose(fDatain);
-			free(pBMPbufhdrin);
-			free(pBMPbufin);
+		return -1;
+	}
+	if(opts.bResume && (opts.bLZ || opts.nFec || opts.bPerm || opts.bAdapt))
+	{
+		// their stream state is not kept in a checkpoint.
+		fprintf(stderr, "ERROR: --resume cannot be combined with --lz, --fec, --perm or --adaptive.\n");
 
-			return -1;
-		}
-		if((pDatabufin = (char *)malloc(BUF_SIZE)) == NULL)
-		{
-			fprintf(stderr, "ERROR: unable to allocate buffer for <data in> data.\n");
-			fclose(fBMPin);
-			fclose(fDatain);
-			free(pBMPbufhdrin);
-			free(pBMPbufin);
+		return -1;
+	}
+	if(argc > 1 && (!strcmp(argv[1], "pack") || !strcmp(argv[1], "split")) && (opts.bLZ || opts.nFec || opts.bPerm || opts.bAdapt))
+	{
+		// archive and shard bodies are embedded as they are, in pixel order.
+		fprintf(stderr, "ERROR: --lz, --fec, --perm and --adaptive are not supported by pack and split.\n");
 
-			return -1;
-		}
-		if((fFileout = fopen(pFileout, "wb")) == NULL)
+		return -1;
+	}
+	bExt = opts.bCRC || opts.bHaskey || opts.bLZ || opts.nFec || opts.bAdapt;
+	// archive commands.
+	if(argc > 1 && !strcmp(argv[1], "pack")) return cmdpack(argc, argv);
+	if(argc > 1 && !strcmp(argv[1], "list")) return cmdlist(argc, argv);
+	if(argc > 1 && !strcmp(argv[1], "extract")) return cmdextract(argc, argv);
+	// multi-cover commands.
+	if(argc > 1 && !strcmp(argv[1], "split")) return cmdsplit(argc, argv);
+	if(argc > 1 && !strcmp(argv[1], "join")) return cmdjoin(argc, argv);
+	// corpus triage.
+	if(argc > 1 && !strcmp(argv[1], "probe")) return cmdprobe(argc, argv);
+	if(argc > 1 && !strcmp(argv[1], "verify")) return cmdverify(argc, argv);
+	if(argc > 1 && !strcmp(argv[1], "analyze")) return cmdanalyze(argc, argv);
+	if(argc > 1 && !strcmp(argv[1], "bench")) return cmdbench(argc, argv);
+	if(argc > 1 && !strcmp(argv[1], "kernels")) return cmdkernels(argc, argv);
+	// hot folder.
+	if(argc > 1 && !strcmp(argv[1], "watch")) return cmdwatch(argc, argv);
+	// corpus retrieval into one tar stream.
+	if(argc > 1 && !strcmp(argv[1], "bulk")) return cmdbulk(argc, argv);
+	// in place edit of an encoded cover.
+	if(argc > 1 && !strcmp(argv[1], "update")) return cmdupdate(argc, argv);
+	// test the input.
+	if(argc != 4 && argc != 6) { usage(); return -1; }
+	if((*argv[1] != 'e' && *argv[1] != 'd') || strlen(argv[1]) != 1) { usage(); return -1; }
+	if(*argv[1] == 'e' && argc != 6) { usage(); return -1; }
+	if(*argv[1] == 'd' && argc != 4) { usage(); return -1; }
+	if(*argv[1] == 'e')
+	{
+		if(!strcmp(argv[2], argv[3]) || !strcmp(argv[2], argv[4]) || !strcmp(argv[3], argv[4]))
 		{
-			fprintf(stderr, "ERROR: unable to open <bmp out>.\n");
-			fclose(fBMPin);
-			fclose(fDatain);
-			free(pBMPbufhdrin);
-			free(pBMPbufin);
-			free(pDatabufin);
+			fprintf(stderr, "ERROR: overlapping file names.\n");
 
 			return -1;
 		}
-		if(fwrite(pBMPbufhdrin, 1, sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER), fFileout) != sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER))
+		if((*argv[5] != 'r' && *argv[5] != 'n' && *argv[5] != 'd' && *argv[5] != 'l') || strlen(argv[5]) != 1)
 		{
-			fprintf(stderr, "ERROR: unable to write <bmp out> header.\n");
-			fclose(fBMPin);
-			fclose(fDatain);
-			fclose(fFileout);
-			free(pBMPbufhdrin);
-			free(pBMPbufin);
-			free(pDatabufin);
-			remove(pFileout);
+			usage();
 
 			return -1;
 		}
-		if(*argv[5] == 'r') nRF = 1;
-		if(*argv[5] == 'd') nRF = 2;
-		if(*argv[5] == 'l') nRF = 3;
-		if((e = encode(fBMPin, fDatain, fFileout, pBMPbufin, pDatabufin, hc, nFS2, nRF)) != 0)
+	}
+	if(*argv[1] == 'd')
+	{
+		if(!strcmp(argv[2], argv[3]))
 		{
-			fprintf(stderr, "ERROR: unable to encode <bmp out> file, code %d.\n", e);
-			fclose(fBMPin);
-			fclose(fDatain);
-			fclose(fFileout);
-			free(pBMPbufhdrin);
-			free(pBMPbufin);
-			free(pDatabufin);
-			remove(pFileout);
+			fprintf(stderr, "ERROR: overlapping file names.\n");
 
 			return -1;
 		}
-		else
-		{
-			fclose(fBMPin);
-			fclose(fDatain);
-			fclose(fFileout);
-			free(pBMPbufhdrin);
-			free(pBMPbufin);
-			free(pDatabufin);
-		}
 	}
-	else
+	if(opts.bStats) statstart();
+	// e and d run on this thread alone.
+	pinworker();
+	PROBE2(job_start, (int)*argv[1], (uintptr_t)argv[2]);
+	// test the input files, each is opened once and sized from its
+	// descriptor.  Mode d has no <data in>.
+	pBMPin = argv[2];
+	pDatain = *argv[1] == 'e' ? argv[3] : NULL;
+	pFileout = *argv[1] == 'e' ? argv[4] : argv[3];
+	memset(&ds, 0, sizeof(ds));
+	memset(&eh, 0, sizeof(eh));
+	memset(&ck, 0, sizeof(ck));
+	nFS1 = 0;
+	nFS2 = 0;
+	if(opts.bResume)
 	{
-		// prepare for decoding.
-		pBMPin = argv[2];
-		pFileout = argv[3];
-		nFS1 = 0;
-		if((x = fopen(pBMPin, "rb")) != NULL)
+		// the checkpoint sits next to the output.
+		if(!strncmp(pFileout, "fd:", 3) || !strncmp(pFileout, "shm:", 4) || snprintf(ck.szPath, sizeof(ck.szPath), "%s.ckpt", pFileout) >= sizeof(ck.szPath) - 4)
 		{
-			fseek(x, 0, SEEK_END);
-			nFS1 = ftell(x);
-			fclose(x);
+			fprintf(stderr, "ERROR: --resume needs a file name for %s.\n", pDatain ? "<bmp out>" : "<data out>");
+			goto cleanup;
 		}
-		if(nFS1 < 1)
+		ck.bId[0] = *argv[1];
+	}
+	if(opts.nGenw && pDatain)
+	{
+		// the generated cover is never read, <bmp in> is given as -.
+		if(strcmp(pBMPin, "-"))
 		{
-			fprintf(stderr, "ERROR: could not get size of <bmp in>.\n");
-
-			return -1;
+			usage();
+			goto cleanup;
 		}
-		if(nFS1 < (sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + MIN_DATA))
+		if(opts.nGenw * 3 < BUF_SIZE && opts.nGenh <= (INT32_MAX - (int)(sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER))) / (((opts.nGenw * 3) + 3) & ~3))
 		{
-			// the BMP file is too small to embed even 1 character.
-			fprintf(stderr, "ERROR: bad file size.\n");
-
-			return -1;
+			nFS1 = (int)(sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER)) + ((((opts.nGenw * 3) + 3) & ~3) * opts.nGenh);
 		}
-		if((fBMPin = fopen(pBMPin, "rb")) == NULL)
+	}
+	else if((fBMPin = fopenpath(pBMPin, "rb")) == NULL)
+	{
+		fprintf(stderr, "ERROR: unable to open <bmp in>.\n");
+		goto cleanup;
+	}
+	else if(fstat(fileno(fBMPin), &st) == 0 && st.st_size <= INT32_MAX)
+	{
+		nFS1 = (int)st.st_size;
+		ckptid(&ck, 0, &st);
+	}
+	if(nFS1 < 1)
+	{
+		fprintf(stderr, "ERROR: could not get size of <bmp in>.\n");
+		goto cleanup;
+	}
+	if(pDatain)
+	{
+		if((fDatain = fopenpath(pDatain, "rb")) == NULL)
 		{
-			fprintf(stderr, "ERROR: unable to open <bmp in>.\n");
-
-			return -1;
+			fprintf(stderr, "ERROR: unable to open <data in>.\n");
+			goto cleanup;
 		}
-		if((pBMPbufhdrin = (char *)malloc(sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER))) == NULL)
+		if(fstat(fileno(fDatain), &st) == 0 && st.st_size <= INT32_MAX) nFS2 = (int)st.st_size;
+		ckptid(&ck, 1, &st);
+		if(nFS2 < 1)
 		{
-			fprintf(stderr, "ERROR: unable to allocate buffer for <bmp in> header.\n");
-			fclose(fBMPin);
-
-			return -1;
+			fprintf(stderr, "ERROR: could not get size of <data in>.\n");
+			goto cleanup;
 		}
-		if((pBMPbufin = (char *)malloc(BUF_SIZE)) == NULL)
+	}
+	if(nFS1 < (sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + MIN_DATA) || (nFS2 > MAX_DATA_FILE && !bExt))
+	{
+		// the BMP file is too small to embed even 1 character, or the data file is too big.
+		fprintf(stderr, "ERROR: bad file size.\n");
+		goto cleanup;
+	}
+	if((pBMPbufhdrin = (char *)malloc(HOST_HDR_MAX)) == NULL || (pBMPbufin = (char *)malloc(BUF_SIZE)) == NULL || (pDatabufin = (char *)malloc(BUF_SIZE)) == NULL)
+	{
+		fprintf(stderr, "ERROR: unable to allocate buffers for <bmp in>.\n");
+		goto cleanup;
+	}
+	statlap(STAT_SETUP, 0);
+	// a cover seen before comes masked and checked from the cache.
+	if(pDatain && opts.pCache && !opts.nRaww && fBMPin) bCached = cacheopen(fBMPin, nFS1, pBMPbufhdrin, &cc) == 0;
+	if(fBMPin == NULL)
+	{
+		bmpheader((uint8_t *)pBMPbufhdrin, opts.nGenw, opts.nGenh);
+		nHdr = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
+	}
+	else if(!bCached && (nHdr = readhost(fBMPin, pBMPbufhdrin, nFS1)) < 0)
+	{
+		fprintf(stderr, "ERROR: unable to read <bmp in> headers.\n");
+		goto cleanup;
+	}
+	nNeed = 0;
+	// a checkpoint of the same inputs and mode is picked up.
+	if(opts.bResume) bResumed = ckptload(&ck) == 0;
+	if(pDatain)
+	{
+		// version 1.1 payload is a 16-bit length followed by <data in>, with
+		// any option an extended header carries a 32-bit length, the crc32c,
+		// the nonce, the decompressed length and the code shape.
+		if(bExt)
 		{
-			fprintf(stderr, "ERROR: unable to allocate buffer for <bmp in> data.\n");
-			fclose(fBMPin);
-			free(pBMPbufhdrin);
-
-			return -1;
+			eh.wFlags = EXT_FLAG_CRC | (opts.bLZ ? EXT_FLAG_LZ : 0) | (opts.nFec ? EXT_FLAG_FEC : 0) | (opts.bPerm ? EXT_FLAG_PERM : 0) | (opts.bAdapt ? EXT_FLAG_ADAPT : 0);
+			eh.dwLength = (uint32_t)nFS2;
+			eh.dwRaw = (uint32_t)nFS2;
+			eh.nFecparity = opts.nFec;
+			eh.nFecdepth = fecdepth(nFS2, opts.nFec);
+			if(opts.bHaskey && bResumed)
+			{
+				// the scan lines written are encrypted under the old nonce.
+				memcpy(eh.bNonce, ck.bNonce, sizeof(eh.bNonce));
+				eh.wFlags |= EXT_FLAG_CHACHA | EXT_FLAG_CRC;
+			}
+			else if(opts.bHaskey && newnonce(&eh))
+			{
+				fprintf(stderr, "ERROR: unable to generate a nonce.\n");
+				goto cleanup;
+			}
+			nPrefix = putexthdr(&eh, pPrefix);
 		}
-		if(fread(pBMPbufhdrin, 1, sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER), fBMPin) != sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER))
+		else
 		{
-			fprintf(stderr, "ERROR: unable to read <bmp in> headers.\n");
-			fclose(fBMPin);
-			free(pBMPbufhdrin);
-			free(pBMPbufin);
-
-			return -1;
+			putle(pPrefix, (uint32_t)nFS2, FILE_SIZE_PIXELS);
+			nPrefix = FILE_SIZE_PIXELS;
 		}
-		// sanity check the headers.
-		hc = validateheaderd(pBMPbufhdrin, nFS1);
-		if(hc.nValid != HDR_CHECKD_PASS)
+		// the compressed size is only known once encode() has run out of
+		// payload or pixels.
+		nNeed = (opts.bLZ ? 1 : (int)fecsize(nFS2, eh.nFecparity, eh.nFecdepth)) + eh.nHdrlen;
+	}
+	// sanity check the headers, one parse for either mode.
+	hc = bCached ? cachecheck(&cc, nNeed) : hostcheck(pBMPbufhdrin, nHdr, nFS1, nNeed, !pDatain);
+	PROBE4(header, hc.nValid, hc.dwFlags, hc.nBMPw, hc.nBMPh);
+	if(hc.nValid != (pDatain ? HDR_CHECKE_PASS : HDR_CHECKD_PASS) || (fBMPin && !bCached && fseeko(fBMPin, hc.nOffset, SEEK_SET)))
+	{
+		fprintf(stderr, "ERROR: <bmp in> header check failed (%08X).\n", hc.dwFlags);
+		goto cleanup;
+	}
+	if(pDatain && opts.bPerm)
+	{
+		// slots are planned for the largest body <data in> can give,
+		// compressed blocks are never more than 4 bytes over.
+		qwPlan = opts.bLZ ? (uint64_t)nFS2 + 4 * (((uint64_t)nFS2 + LZ_BLOCK - 1) / LZ_BLOCK) : (uint64_t)nFS2;
+		qwPlan = fecsize(qwPlan, eh.nFecparity, eh.nFecdepth);
+		qwRegion = (uint64_t)hc.nBMPw * hc.nBMPh - nPrefix;
+		eh.dwPlan = (uint32_t)(qwPlan < qwRegion ? qwPlan : qwRegion);
+		putexthdr(&eh, pPrefix);
+	}
+	statlap(STAT_HEADER, hc.nOffset);
+	if(bResumed && (ck.wFlags != eh.wFlags || (fFileout = fopenpath(pFileout, "rb+")) == NULL || ckptcheck(&ck, fFileout, pDatain ? hc.nOffset + (uint64_t)ck.nRow * hc.nStride : ck.qwPos)))
+	{
+		// the output changed since, or was never written that far.
+		fprintf(stderr, "WARNING: %s does not match its checkpoint, starting over.\n", pDatain ? "<bmp out>" : "<data out>");
+		if(fFileout) fclose(fFileout);
+		fFileout = NULL;
+		bResumed = 0;
+	}
+	if(opts.bResume && !bResumed)
+	{
+		ck.wFlags = eh.wFlags;
+		memcpy(ck.bNonce, eh.bNonce, sizeof(ck.bNonce));
+		ck.bDone = 0;
+		ck.nRow = 0;
+		ck.qwPos = 0;
+		ck.dwCRC = 0;
+		ck.qwBlock = pDatain ? hc.nOffset : 0;
+		ck.dwBlock = 0;
+		ck.dwBlockcrc = 0;
+	}
+	if(fFileout == NULL && (fFileout = fopenpath(pFileout, pDatain ? "wb+" : "wb")) == NULL)
+	{
+		fprintf(stderr, "ERROR: unable to open %s.\n", pDatain ? "<bmp out>" : "<data out>");
+		goto cleanup;
+	}
+	statlap(STAT_SETUP, 0);
+	ck.fOut = fFileout;
+	if(pDatain)
+	{
+		if(!bResumed && fwrite(pBMPbufhdrin, 1, hc.nOffset, fFileout) != hc.nOffset)
 		{
-			fprintf(stderr, "ERROR: <bmp in> header check failed (%08X).\n", hc.dwFlags);
-			fclose(fBMPin);
-			free(pBMPbufhdrin);
-			free(pBMPbufin);
-
-			return -1;
+			fprintf(stderr, "ERROR: unable to write <bmp out> header.\n");
+			goto cleanup;
 		}
-		if((fFileout = fopen(pFileout, "wb")) == NULL)
+		statlap(STAT_WRITE, hc.nOffset);
+		nRF = fillmode(argv[5]);
+		memset(&m, 0, sizeof(m));
+		m.fIn = fDatain;
+		m.dwLength = (uint32_t)nFS2;
+		initsrc(&ds, pPrefix, nPrefix, &m, 1);
+		srccipher(&ds, &eh);
+		if(bCached) ds.pCover = &cc;
+		if(opts.nGenw)
 		{
-			fprintf(stderr, "ERROR: unable to open <data out>.\n");
-			fclose(fBMPin);
-			free(pBMPbufhdrin);
-			free(pBMPbufin);
-
-			return -1;
+			// fresh noise for every cover.
+			gc.nW = hc.nBMPw;
+			gc.nH = hc.nBMPh;
+			gc.nStride = hc.nStride;
+			if(getrandom(&gc.qwState, sizeof(gc.qwState), 0) != sizeof(gc.qwState)) gc.qwState = (uint64_t)time(NULL) * 0x9e3779b97f4a7c15ULL;
+			gc.qwState |= 1;
+			ds.pGen = &gc;
 		}
-		if((e = decode(fBMPin, fFileout, pBMPbufin, hc)) != 0)
+		if(opts.bLZ && (ds.pLz = (PLZSTREAM)malloc(sizeof(LZSTREAM))) == NULL) e = -5;
+		else if(opts.bLZ) ds.pLz->nOut = ds.pLz->nPos = 0;
+		if(opts.nFec && (ds.pFec = fecnew(eh.nFecparity, eh.nFecdepth)) == NULL) e = -5;
+		if(opts.bPerm && (ds.pPerm = permnew(&ds.ci, eh.dwPlan, qwRegion)) == NULL) e = -5;
+		if(opts.bAdapt && (ds.pAdapt = adaptnew(hc.nBMPw)) == NULL) e = -5;
+		if(opts.bResume) ds.pCkpt = &ck;
+		if(bResumed && ckptsrc(&ck, &ds)) e = -1;
+		if(bResumed && fBMPin && !bCached && fseeko(fBMPin, hc.nOffset + (off_t)ck.nRow * hc.nStride, SEEK_SET)) e = -1;
+		statlap(STAT_SETUP, 0);
+		if(e == 0 && (e = encode(fBMPin, fFileout, pBMPbufin, pDatabufin, hc, &ds, nRF)) == 0) eh.dwLength = (uint32_t)ds.qwCoded;
+		statlap(STAT_FINISH, 0);
+		if(e != 0 || ((eh.wFlags & EXT_FLAG_CRC) && (e = patchhdr(fFileout, hc, &eh, &ds, (uint8_t *)pBMPbufin)) != 0))
 		{
-			fprintf(stderr, "ERROR: unable to encode <data out> file, code %d.\n", e);
-			fclose(fBMPin);
-			fclose(fFileout);
-			free(pBMPbufhdrin);
-			free(pBMPbufin);
-			remove(pFileout);
-
-			return -1;
+			if(e == -4) fprintf(stderr, "ERROR: <data in> does not fit in <bmp in>.\n");
+			else fprintf(stderr, "ERROR: unable to encode <bmp out> file, code %d.\n", e);
+			goto cleanup;
 		}
-		else
+	}
+	else
+	{
+		e = decode(fBMPin, fFileout, pBMPbufin, hc, opts.bResume ? &ck : NULL);
+		statlap(STAT_FINISH, 0);
+		if(e != 0)
 		{
-			fclose(fBMPin);
-			fclose(fFileout);
-			free(pBMPbufhdrin);
-			free(pBMPbufin);
+			if(e == DEC_ARCHIVE) fprintf(stderr, "ERROR: <bmp in> holds an archive, use list or extract.\n");
+			else if(e == DEC_SHARD) fprintf(stderr, "ERROR: <bmp in> holds one shard of a split payload, use join.\n");
+			else if(e == DEC_CRC) fprintf(stderr, "ERROR: <data out> does not match the checksum in <bmp in>.\n");
+			else if(e == DEC_KEY) fprintf(stderr, "ERROR: <bmp in> is encrypted, give --key-file or --key-env.\n");
+			else if(e == DEC_FEC) fprintf(stderr, "ERROR: <bmp in> has too many damaged pixels to correct.\n");
+			else fprintf(stderr, "ERROR: unable to encode <data out> file, code %d.\n", e);
+			goto cleanup;
 		}
 	}
+	ret = 0;
 
-	return 0;
+cleanup:
+	free(ds.pLz);
+	fecfree(ds.pFec);
+	bigfree(ds.pPerm);
+	free(ds.pAdapt);
+	if(bCached) cacheclose(&cc);
+	if(fBMPin) fclose(fBMPin);
+	if(fDatain) fclose(fDatain);
+	if(fFileout && fclose(fFileout) && ret == 0)
+	{
+		fprintf(stderr, "ERROR: unable to write %s.\n", pDatain ? "<bmp out>" : "<data out>");
+		ret = -1;
+	}
+	// under --resume a failed run keeps what its checkpoint covers.
+	if(ret && fFileout && !(ck.bSaved || bResumed)) removepath(pFileout);
+	if(ret == 0 && opts.bResume) remove(ck.szPath);
+	free(pBMPbufhdrin);
+	free(pBMPbufin);
+	free(pDatabufin);
+	// setup failures report the status returned.
+	if(ret && e == 0) e = ret;
+	if(ret) PROBE2(error, (int)*argv[1], e);
+	PROBE2(job_end, (int)*argv[1], ret ? e : 0);
+	if(stats.bOn) statreport(argv[1], ret ? e : 0);
+
+	return ret;
 }
 
 int usage()
 {
 	// print the command line options.
-	fprintf(stderr, "Usage: bmpsteg-lin <mode e> <bmp in> <data in> <bmp out> <fill>\n");
-	fprintf(stderr, "       bmpsteg-lin <mode d> <bmp in> <data out>\n\n");
+	fprintf(stderr, "Usage: bmpsteg-lin [<options>] <mode e> <bmp in> <data in> <bmp out> <fill>\n");
+	fprintf(stderr, "       bmpsteg-lin [<options>] <mode d> <bmp in> <data out>\n");
+	fprintf(stderr, "       bmpsteg-lin pack <bmp in> <bmp out> <fill> <member in>...\n");
+	fprintf(stderr, "       bmpsteg-lin list <bmp in>\n");
+	fprintf(stderr, "       bmpsteg-lin extract <bmp in> <member> <data out>\n");
+	fprintf(stderr, "       bmpsteg-lin split <data in> <fill> <bmp in> <bmp out> [<bmp in> <bmp out>]...\n");
+	fprintf(stderr, "       bmpsteg-lin join <data out> <bmp in>...\n");
+	fprintf(stderr, "       bmpsteg-lin probe [-j <threads>] <bmp in | dir>...\n");
+	fprintf(stderr, "       bmpsteg-lin verify <bmp in>...\n");
+	fprintf(stderr, "       bmpsteg-lin analyze [-j <threads>] <bmp in | dir>...\n");
+	fprintf(stderr, "       bmpsteg-lin bench [-d <dir>] [-r <repeat>] [-s quick | full]\n");
+	fprintf(stderr, "       bmpsteg-lin kernels test [-n <scan lines>] | bench [-n <pixels>]\n");
+	fprintf(stderr, "       bmpsteg-lin update <bmp> <data in> [<fill>]\n");
+	fprintf(stderr, "       bmpsteg-lin watch [-j <threads>] e <spool dir> <done dir> <bmp in> <fill>\n");
+	fprintf(stderr, "       bmpsteg-lin watch [-j <threads>] d <spool dir> <done dir>\n");
+	fprintf(stderr, "       bmpsteg-lin bulk [-j <threads>] [-s] <tar out> <bmp in | dir>...\n\n");
 	fprintf(stderr, "<mode> The mode of operation, either e or d. Mode e encodes <bmp in> with\n");
 	fprintf(stderr, "       bytes from <data in> and stores the results in <bmp out>.  Mode d\n");
 	fprintf(stderr, "       decodes the embedded data from <bmp in> and stores the results in\n");
@@ -411,12 +1313,114 @@ int usage()
 	fprintf(stderr, "       by inserting random bits into unused pixels. This parameter is either\n");
 	fprintf(stderr, "       r for random, d for random dark bias, l for random light bias or n for\n");
 	fprintf(stderr, "       no fill. If <bmp out> shows banding visually then experiment with these\n");
-	fprintf(stderr, "       parameters to produce less noticeable artifacts.\n\n");
+	fprintf(stderr, "       parameters to produce less noticeable artifacts.\n");
+	fprintf(stderr, "pack   Embeds the <member in> files as an archive with an index of names,\n");
+	fprintf(stderr, "       offsets, lengths and checksums in the leading pixels.  list prints\n");
+	fprintf(stderr, "       the index and extract decodes a single member by name, reading only\n");
+	fprintf(stderr, "       the scan lines holding the index and that member.\n");
+	fprintf(stderr, "split  Shares <data in> out over several covers in proportion to their\n");
+	fprintf(stderr, "       capacity, encoding them in parallel.  join takes the covers in any\n");
+	fprintf(stderr, "       order and reassembles <data out>.\n");
+	fprintf(stderr, "probe  Reads only the headers and first scan line of each <bmp in>, or of\n");
+	fprintf(stderr, "       every *.bmp below each dir, and prints a verdict with the embedded\n");
+	fprintf(stderr, "       length: payload (extended header), possible (1.1 length fits),\n");
+	fprintf(stderr, "       clean or invalid (header check flags shown instead).\n");
+	fprintf(stderr, "--crc  Mode e stores a crc32c of <data in> in an extended header, which\n");
+	fprintf(stderr, "       also lifts the %d byte limit.  pack and split always do.  Decoding\n", MAX_DATA_FILE);
+	fprintf(stderr, "       fails on a mismatch, and verify checks covers without writing the\n");
+	fprintf(stderr, "       payload: ok, corrupt, nocrc, nokey or invalid.\n");
+	fprintf(stderr, "analyze\n");
+	fprintf(stderr, "       Runs the chi-square, RS and sample pair attacks on the LSBs of each\n");
+	fprintf(stderr, "       channel, BGR order, and scores the estimated share of embedded pixels.\n");
+	fprintf(stderr, "       Files scoring %.2f or more are suspect and the exit status is 1.\n", ANALYZE_SUSPECT_AT);
+	fprintf(stderr, "bench  Generates the same synthetic covers and payloads on every run and\n");
+	fprintf(stderr, "       times e and d in each fill mode, the fastest of <repeat> runs.  One\n");
+	fprintf(stderr, "       JSON object per line gives MB/s, pixels/s, peak RSS and the read and\n");
+	fprintf(stderr, "       write calls.  full adds a cover of about 2 GB, files go in <dir>.\n");
+	fprintf(stderr, "       Shapes not supported yet, 4K and 16K wide and over 3 GB, are\n");
+	fprintf(stderr, "       listed with the status unsupported.\n");
+	fprintf(stderr, "kernels\n");
+	fprintf(stderr, "       test compares every embed and extract kernel the cpu runs with the\n");
+	fprintf(stderr, "       scalar code on <scan lines> random scan lines, bench times them per\n");
+	fprintf(stderr, "       scan line across widths and alignments, on at least <pixels> pixels\n");
+	fprintf(stderr, "       and %g ms per pass after a warm-up, the fastest of %d passes.\n", KERNEL_BENCH_MIN * 1e3, KERNEL_BENCH_RUNS);
+	fprintf(stderr, "update Replaces the payload of an encoded <bmp> with <data in> in place, in\n");
+	fprintf(stderr, "       the same layout, rewriting only the scan lines whose pixels change.\n");
+	fprintf(stderr, "       With <fill>, pixels the old payload used past the end of the new one\n");
+	fprintf(stderr, "       are filled, otherwise they keep the old bytes.  An encrypted payload\n");
+	fprintf(stderr, "       gets a new nonce, which changes every scan line it covers.\n");
+	fprintf(stderr, "watch  Runs e or d on every file written or moved into <spool dir> as soon\n");
+	fprintf(stderr, "       as it is closed, and on those already there.  e embeds each file in\n");
+	fprintf(stderr, "       <bmp in> as <done dir>/<name>.bmp, d decodes each cover into\n");
+	fprintf(stderr, "       <done dir>/<name>.out.  Outputs appear whole by rename, inputs are\n");
+	fprintf(stderr, "       removed when done or left as .<name>.failed.  Names starting with a\n");
+	fprintf(stderr, "       dot are ignored.  Runs until interrupted.\n");
+	fprintf(stderr, "bulk   Decodes each <bmp in>, or every *.bmp below each dir, on <threads>\n");
+	fprintf(stderr, "       workers and streams the payloads into one tar file as <path>.out,\n");
+	fprintf(stderr, "       in the order they finish or sorted by path with -s.  At most %d MiB\n", BULK_BUFFER >> 20);
+	fprintf(stderr, "       of payloads wait for the writer.  Covers without a payload are\n");
+	fprintf(stderr, "       skipped with a reason and the exit status is 1.\n");
+	fprintf(stderr, "<bmp in>, <data in> and the outputs of every mode may also be given as\n");
+	fprintf(stderr, "       fd:<n> for a descriptor the caller passed down, such as a memfd, or as\n");
+	fprintf(stderr, "       shm:/<name> for a POSIX shared memory object, which outputs create.\n");
+	fprintf(stderr, "--key-file <file>, --key-env <var>\n");
+	fprintf(stderr, "       Encrypts the payload with ChaCha20 while it is embedded, and\n");
+	fprintf(stderr, "       decrypts it while it is extracted.  The 256-bit key is 32 raw bytes\n");
+	fprintf(stderr, "       or 64 hex digits, options go before any mode.\n");
+	fprintf(stderr, "--lz   Mode e compresses <data in> in 64 KiB blocks as it is embedded,\n");
+	fprintf(stderr, "       mode d decompresses it, so text and logs fit in smaller covers.\n");
+	fprintf(stderr, "--fec <parity>\n");
+	fprintf(stderr, "       Mode e adds <parity> (%d to %d) Reed-Solomon bytes to every 255 byte\n", FEC_MIN_PARITY, FEC_MAX_PARITY);
+	fprintf(stderr, "       codeword, interleaved so that one damaged scan line is spread over many\n");
+	fprintf(stderr, "       codewords.  Mode d corrects up to <parity> / 2 bad bytes per codeword.\n");
+	fprintf(stderr, "--perm  Mode e spreads the payload over the whole image in an order drawn\n");
+	fprintf(stderr, "       from the key, so the used pixels do not form a block.  Needs a key.\n");
+	fprintf(stderr, "--adaptive\n");
+	fprintf(stderr, "       Mode e embeds up to 8 bits in busy areas of <bmp in> and none in\n");
+	fprintf(stderr, "       flat ones, so smooth skies and gradients show no banding.  Fewer\n");
+	fprintf(stderr, "       bytes fit, mode d finds the same areas on its own.\n");
+	fprintf(stderr, "--stats\n");
+	fprintf(stderr, "       Modes e and d print one JSON object to stdout when done: wall and\n");
+	fprintf(stderr, "       cpu seconds, calls and bytes for each phase (setup, header, cover,\n");
+	fprintf(stderr, "       payload, transform, fill, write, finish), read and write system\n");
+	fprintf(stderr, "       calls, the embed kernel, the thread count and the peak resident bytes.\n");
+	fprintf(stderr, "--cache <dir>\n");
+	fprintf(stderr, "       Mode e keeps a masked copy of each <bmp in> in <dir> with its checked\n");
+	fprintf(stderr, "       headers, and encodes from it while <bmp in> is unchanged.\n");
+	fprintf(stderr, "--raw <w>x<h>\n");
+	fprintf(stderr, "       Modes e and d take <bmp in> as <w> by <h> headerless 24-bit pixels,\n");
+	fprintf(stderr, "       scan lines unpadded, as a frame from a decoder or camera pipeline.\n");
+	fprintf(stderr, "       Without it a binary PPM (P6) or PAM (P7, depth 3) with a maxval of\n");
+	fprintf(stderr, "       255 is used as it is in place of a BMP, its header kept by e.  update\n");
+	fprintf(stderr, "       takes the same covers, pack, list, extract, split, join and verify\n");
+	fprintf(stderr, "       take BMP covers only.\n");
+	fprintf(stderr, "--generate <w>x<h>\n");
+	fprintf(stderr, "       Mode e makes up a <w> by <h> cover of gradients and fresh noise as it\n");
+	fprintf(stderr, "       embeds, nothing is read for it.  Give - for <bmp in>.\n");
+	fprintf(stderr, "--mem-limit <bytes>[k | m | g]\n");
+	fprintf(stderr, "       Keeps heap and thread stacks under the limit.  split, join, verify,\n");
+	fprintf(stderr, "       probe and analyze start fewer workers to fit, and an allocation past\n");
+	fprintf(stderr, "       the limit fails with an error instead of the process being killed.\n");
+	fprintf(stderr, "--hugepages\n");
+	fprintf(stderr, "       Puts the --perm band buffers on huge pages, reserved ones while\n");
+	fprintf(stderr, "       /proc/sys/vm/nr_hugepages has them and transparent ones otherwise,\n");
+	fprintf(stderr, "       and asks for huge pages on --cache mappings.\n");
+	fprintf(stderr, "--pin  Binds each worker, and the one thread of e and d, to a cpu of its\n");
+	fprintf(stderr, "       own, NUMA nodes taken in turn, so its buffers stay on its node.\n");
+	fprintf(stderr, "       bench applies both options to every run and reports them.\n");
+	fprintf(stderr, "--resume\n");
+	fprintf(stderr, "       e and d save their progress in <out>.ckpt every %d MB of output,\n", CKPT_BYTES >> 20);
+	fprintf(stderr, "       flushed to disk first, and a failed run keeps the output.  Run the\n");
+	fprintf(stderr, "       same command again to check the last block written and carry on\n");
+	fprintf(stderr, "       from there, a changed input or output starts over.  Not with --lz,\n");
+	fprintf(stderr, "       --fec, --perm or --adaptive, and d decodes such bodies whole.\n\n");
 	fprintf(stderr, "(Examples)\n");
 	fprintf(stderr, "Encode: bmpsteg-lin e /dir/img.in.bmp /dir/doc.in.txt /dir/img.out.bmp r\n");
-	fprintf(stderr, "Decode: bmpsteg-lin d /dir/img.out.bmp /dir/doc.out.txt\n\n");
+	fprintf(stderr, "Decode: bmpsteg-lin d /dir/img.out.bmp /dir/doc.out.txt\n");
+	fprintf(stderr, "Pack:   bmpsteg-lin pack /dir/img.in.bmp /dir/img.out.bmp r a.txt b.pdf\n");
+	fprintf(stderr, "Pull:   bmpsteg-lin extract /dir/img.out.bmp b.pdf /dir/b.out.pdf\n\n");
 	fprintf(stderr, "The <bmp in> file must be a 24-bit uncompressed RGB bitmap without color space\n");
-	fprintf(stderr, "information. Max size of <data in> is %d bytes.\n\nReleased under the \"BSD Modified\" license, Bill Chaison (c) 2018.\n", MAX_DATA_FILE);
+	fprintf(stderr, "information. Max size of <data in> is %d bytes unless --crc, pack may fill the image.\n\nReleased under the \"BSD Modified\" license, Bill Chaison (c) 2018.\n", MAX_DATA_FILE);
 
 	return 0;
 }
@@ -433,12 +1437,14 @@ uint8_t endian(void)
 	return e.c[0];
 }
 
-HDRCHECK validateheadere(void *p, int i, int j)
+HDRCHECK validateheader(void *p, int i, int j, int bDecode)
 {
-	// sanity check the BMP headers for encode.
+	// sanity check the BMP headers of a file of i bytes, for encoding j
+	// payload pixels or for decode, which has one check fewer.
 	HDRCHECK hc = { 0 };
 	PBITMAPFILEHEADER pBMPhdrin;
 	PBITMAPINFOHEADER pBMPinfoin;
+	int w, h;
 
 	pBMPhdrin = (PBITMAPFILEHEADER)p;
 	pBMPinfoin = (PBITMAPINFOHEADER)(p + sizeof(BITMAPFILEHEADER));
@@ -448,9 +1454,12 @@ HDRCHECK validateheadere(void *p, int i, int j)
 	if((uint32_t)pBMPhdrin->bfReserved1 == 0) { hc.nValid++; hc.dwFlags |= 4; } // reserved bytes valid.
 	if(pBMPhdrin->bfOffBits == (uint32_t)(sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER))) { hc.nValid++; hc.dwFlags |= 8; } // data offset valid.
 	if(pBMPinfoin->biSize == (uint32_t)sizeof(BITMAPINFOHEADER)) { hc.nValid++; hc.dwFlags |= 16; } // BMP info header size valid.
-	hc.nBMPw = pBMPinfoin->biWidth;
-	hc.nBMPh = abs(pBMPinfoin->biHeight); // remove sign, origin not important.
-	if(hc.nBMPw > 0 && hc.nBMPh > 0) { hc.nValid++; hc.dwFlags |= 32; } // pixel width and height valid.
+	// remove the sign of the height, origin not important. INT32_MIN has
+	// no positive value and is left at 0 with the other bad sizes.
+	w = pBMPinfoin->biWidth;
+	h = pBMPinfoin->biHeight == INT32_MIN ? 0 : abs(pBMPinfoin->biHeight);
+	if(w > 0 && h > 0 && w < BUF_SIZE && h <= INT32_MAX / w) { hc.nBMPw = w; hc.nBMPh = h; }
+	if(bDecode ? (uint64_t)hc.nBMPw * hc.nBMPh > 2 : hc.nBMPw > 0) { hc.nValid++; hc.dwFlags |= 32; } // pixel width and height valid, for at least one char when decoding.
 	if(pBMPinfoin->biPlanes == 1) { hc.nValid++; hc.dwFlags |= 64; } // BMP planes valid.
 	if(pBMPinfoin->biBitCount == 24) { hc.nValid++; hc.dwFlags |= 128; } // bits per pixel valid.
 	if(pBMPinfoin->biCompression == BI_RGB) { hc.nValid++; hc.dwFlags |= 256; } // uncompressed RGB valid.
@@ -462,268 +1471,5429 @@ HDRCHECK validateheadere(void *p, int i, int j)
 	if(!(hc.nStride % 4) && hc.nStride < BUF_SIZE) { hc.nValid++; hc.dwFlags |= 4096; } // scan line is a multiple of 4 and not too big.
 	hc.nPadding = hc.nStride - (hc.nBMPw * 3);
 	if(hc.nPadding > -1) { hc.nValid++; hc.dwFlags |= 8192; } // null padding value is valid.
-	if(hc.nBMPdlen == (hc.nBMPh * hc.nStride)) { hc.nValid++; hc.dwFlags |= 16384; } // image file data length is valid for scan line.
-	if(((hc.nBMPw * hc.nBMPh) - FILE_SIZE_PIXELS) >= j) { hc.nValid++; hc.dwFlags |= 32768; } // data file is not too big to embed into the given BMP file.
+	if((uint64_t)hc.nBMPdlen == (uint64_t)hc.nBMPh * hc.nStride) { hc.nValid++; hc.dwFlags |= 16384; } // image file data length is valid for scan line.
+	hc.nOffset = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
+	if(!bDecode && (uint64_t)hc.nBMPw * hc.nBMPh >= (uint64_t)j + FILE_SIZE_PIXELS) { hc.nValid++; hc.dwFlags |= 32768; } // data file is not too big to embed into the given BMP file.
 
 	return hc;
 }
 
-HDRCHECK validateheaderd(void *p, int i)
+int encode(FILE *fBMPin, FILE *fFileout, char *pBMPbufin, char *pDatabufin, HDRCHECK hc, PDATASRC ds, int nRF)
 {
-	// sanity check the BMP headers for decode.
-	HDRCHECK hc = { 0 };
-	PBITMAPFILEHEADER pBMPhdrin;
-	PBITMAPINFOHEADER pBMPinfoin;
-
-	pBMPhdrin = (PBITMAPFILEHEADER)p;
-	pBMPinfoin = (PBITMAPINFOHEADER)(p + sizeof(BITMAPFILEHEADER));
+	// encodes <bmp out> from <bmp in> and the payload stream.
+	// Each payload byte is spread across low-order BGR bits.
+	// Some studies suggest that the eye is more sensitive to changes
+	// in green. So only 2 bits will be robbed from G, while 3 bits
+	// will be robbed from B and R. 2 bits represents 1.5% of the
+	// color space, 3 bits represents 3.1% of the color space.
+	// The payload stream starts with the length pixels, see
+	// putexthdr() and main().
+	//  fBMPin at start of image data in <bmp in>.
+	//  fFileout at start of image data of <bmp out>.
+	//  pBMPbufin head of buffer to read scan lines from <bmp in>.
+	//  pDatabufin head of buffer to hold payload bytes for one scan line.
+	//  hc context values for reading, writing and encoding.
+	//  ds payload stream, see readsrc().
+	//  nRF 1 to random fill unused bytes, 2 for dark fill, 3 for
+	//      light fill, 0 no fill.
+	// BMP data starts at the bottom lefthand corner of the image.
+	//  ds->nRow0 scan lines already in <bmp out>, fBMPin and fFileout
+	//      past them, see ckptsrc().
+	int hpels, n = 0, done = ds->nRow0 ? ds->pCkpt->bDone : 0;
 
-	if(pBMPhdrin->bfType[0] == 'B') { hc.nValid++; hc.dwFlags |= 1; } // BMP signature valid.
-	if(pBMPhdrin->bfType[1] == 'M') { hc.nValid++; hc.dwFlags |= 2; } // BMP signature valid.
-	if((uint32_t)pBMPhdrin->bfReserved1 == 0) { hc.nValid++; hc.dwFlags |= 4; } // reserved bytes valid.
-	if(pBMPhdrin->bfOffBits == (uint32_t)(sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER))) { hc.nValid++; hc.dwFlags |= 8; } // data offset valid.
-	if(pBMPinfoin->biSize == (uint32_t)sizeof(BITMAPINFOHEADER)) { hc.nValid++; hc.dwFlags |= 16; } // BMP info header size valid.
-	hc.nBMPw = pBMPinfoin->biWidth;
-	hc.nBMPh = abs(pBMPinfoin->biHeight); // remove sign, origin not important.
-	if((hc.nBMPw * hc.nBMPh) > 2) { hc.nValid++; hc.dwFlags |= 32; } // pixel width and height valid for at least one char.
-	if(pBMPinfoin->biPlanes == 1) { hc.nValid++; hc.dwFlags |= 64; } // BMP planes valid.
-	if(pBMPinfoin->biBitCount == 24) { hc.nValid++; hc.dwFlags |= 128; } // bits per pixel valid.
-	if(pBMPinfoin->biCompression == BI_RGB) { hc.nValid++; hc.dwFlags |= 256; } // uncompressed RGB valid.
-	hc.nBMPdlen = i - sizeof(BITMAPFILEHEADER) - sizeof(BITMAPINFOHEADER);
-	if(pBMPinfoin->biSizeImage == 0 || pBMPinfoin->biSizeImage == hc.nBMPdlen) { hc.nValid++; hc.dwFlags |= 512; } // image data struct size valid.
-	if(pBMPinfoin->biClrUsed == 0) { hc.nValid++; hc.dwFlags |= 1024; } // valid for BMP file.
-	if(pBMPinfoin->biClrImportant == 0) { hc.nValid++; hc.dwFlags |= 2048; } // valid for BMP file.
-	hc.nStride = (((hc.nBMPw * pBMPinfoin->biBitCount) + 31) & ~31) >> 3;
-	if(!(hc.nStride % 4) && hc.nStride < BUF_SIZE) { hc.nValid++; hc.dwFlags |= 4096; } // scan line is a multiple of 4 and not too big.
-	hc.nPadding = hc.nStride - (hc.nBMPw * 3);
-	if(hc.nPadding > -1) { hc.nValid++; hc.dwFlags |= 8192; } // null padding value is valid.
-	if(hc.nBMPdlen == (hc.nBMPh * hc.nStride)) { hc.nValid++; hc.dwFlags |= 16384; } // image file data length is valid for scan line.
+	// a scan line of payload bytes leaves room in pDatabufin for the mask.
+	if(ds->pPerm) ds->pMask = (uint8_t *)pDatabufin + hc.nBMPw;
+	for(hpels = hc.nBMPh - ds->nRow0; hpels; hpels--)
+	{
+		// masked cached scan lines only need restoring when some pixels
+		// keep their bits, every pixel is written with r, d and l fill.
+		if(ds->pCover) coverrow(ds->pCover, hc.nBMPh - hpels, (uint8_t *)pBMPbufin, ds->pPerm || ds->pAdapt || !nRF);
+		else if(ds->pGen) genrow(ds->pGen, hc.nBMPh - hpels, (uint8_t *)pBMPbufin);
+		else if(fread(pBMPbufin, 1, hc.nStride, fBMPin) != hc.nStride) return -1;
+		statlap(STAT_COVER, hc.nStride);
+		PROBE2(row_read, hc.nBMPh - hpels, hc.nStride);
+		if(ds->pAdapt)
+		{
+			// fills its own pixels past the end of the payload.
+			if((n = adaptrow(ds, (uint8_t *)pBMPbufin, (uint8_t *)pDatabufin, hc.nBMPw, (uint32_t)(hc.nBMPh - hpels) * hc.nBMPw, done, nRF)) < 0) return -2;
+			if(n && !done) PROBE3(fill, hc.nBMPh - hpels, hc.nBMPw, nRF);
+			if(n) done = 1;
+			statlap(STAT_TRANSFORM, hc.nBMPw * 3);
+			PROBE2(row_transform, hc.nBMPh - hpels, hc.nBMPw);
+		}
+		else if(!done)
+		{
+			if((n = readsrc(ds, (uint8_t *)pDatabufin, hc.nBMPw)) < 0) return -2;
+			statlap(STAT_PAYLOAD, n);
+			if(ds->pPerm) embedmasked((uint8_t *)pBMPbufin, (uint8_t *)pDatabufin, ds->pMask, n, nRF);
+			else embedrow((uint8_t *)pBMPbufin, (uint8_t *)pDatabufin, n);
+			if(n < hc.nBMPw) done = 1;
+			statlap(STAT_TRANSFORM, n * 3);
+			PROBE2(row_transform, hc.nBMPh - hpels, n);
+			if(done) PROBE3(fill, hc.nBMPh - hpels, n, nRF);
+		}
+		else
+		{
+			n = 0;
+		}
+		// pixels past the end of the payload.
+		if(done && !ds->pAdapt)
+		{
+			fillrow((uint8_t *)pBMPbufin + (n * 3), hc.nBMPw - n, nRF);
+			statlap(STAT_FILL, (hc.nBMPw - n) * 3);
+		}
+		if(fwrite(pBMPbufin, 1, hc.nStride, fFileout) != hc.nStride) return -3;
+		if(ds->pCkpt && ckptrow(ds, (uint8_t *)pBMPbufin, hc.nStride, hc.nBMPh - hpels + 1, done)) return -3;
+		statlap(STAT_WRITE, hc.nStride);
+		PROBE2(row_write, hc.nBMPh - hpels, hc.nStride);
+	}
+	// the payload must have fit in the image, bits included.
+	if(!done && (readsrc(ds, (uint8_t *)pDatabufin, 1) != 0 || (ds->pAdapt && ds->pAdapt->nAcc))) return -4;
+	if(ds->pPerm) ds->pMask = NULL;
+
+	return 0;
+}
+
+int decode(FILE *fBMPin, FILE *fFileout, char *pBMPbufin, HDRCHECK hc, PCHECKPOINT pCkpt)
+{
+	// decodes <data out> from <bmp in>.
+	//  fBMPin at start of image data in <bmp in>.
+	//  pCkpt --resume progress, fFileout at its qwPos, or NULL.
+	PIXRDR pr;
+	EXTHDR eh;
+	uint32_t dwCRC;
+	int e;
+
+	pxinit(&pr, fBMPin, pBMPbufin, hc);
+	if((e = readpayloadhdr(&pr, &eh)) != 0) return e;
+	if(eh.wFlags & EXT_FLAG_ARCHIVE) return DEC_ARCHIVE;
+	if(eh.wFlags & EXT_FLAG_SHARD) return DEC_SHARD;
+	if(pCkpt && !(eh.wFlags & (EXT_FLAG_LZ | EXT_FLAG_FEC | EXT_FLAG_PERM | EXT_FLAG_ADAPT)))
+	{
+		// a body in pixel order picks up at the pixel of the first byte
+		// not yet written, other layouts are decoded whole.
+		if(pCkpt->qwPos > eh.dwData) return -1;
+		if(pCkpt->qwPos && pxseek(&pr, (uint32_t)pr.nRow * hc.nBMPw + pr.nCol + (uint32_t)pCkpt->qwPos)) return -2;
+		pr.pCkpt = pCkpt;
+	}
+	if(eh.wFlags & EXT_FLAG_LZ) e = lzcopy(&pr, &eh, fFileout, &dwCRC);
+	else e = pxcopy(&pr, eh.dwData - (pr.pCkpt ? (uint32_t)pCkpt->qwPos : 0), fFileout, &dwCRC);
+	if(pr.pFec && pr.pFec->bFailed) e = DEC_FEC;
+	else if(e) e -= 10;
+	else if((eh.wFlags & EXT_FLAG_CRC) && dwCRC != eh.dwCRC) e = DEC_CRC;
+	pxclose(&pr);
+
+	return e;
+}
+
+int fillmode(char *p)
+{
+	// returns nRF for the <fill> parameter, -1 when not valid.
+	if(strlen(p) != 1) return -1;
+	if(*p == 'n') return 0;
+	if(*p == 'r') return 1;
+	if(*p == 'd') return 2;
+	if(*p == 'l') return 3;
+
+	return -1;
+}
+
+uint32_t crctable[8][256]; // slicing-by-8 tables, crctable[0] is the bytewise table.
+uint32_t crcx2n[64]; // x^(2^k) modulo the crc32c polynomial.
+uint32_t (*pfncrc)(uint32_t dwCRC, const uint8_t *p, size_t n); // selected by crc32cinit().
+pthread_once_t crconce = PTHREAD_ONCE_INIT;
+
+void crc32cinit(void)
+{
+	// builds the tables and picks the SSE4.2 kernel when the cpu has it.
+	uint32_t c;
+	int i, k;
+
+	for(i = 0; i < 256; i++)
+	{
+		c = i;
+		for(k = 0; k < 8; k++) c = (c & 1) ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+		crctable[0][i] = c;
+	}
+	for(i = 0; i < 256; i++)
+	{
+		for(k = 1; k < 8; k++) crctable[k][i] = (crctable[k - 1][i] >> 8) ^ crctable[0][crctable[k - 1][i] & 0xff];
+	}
+	crcx2n[0] = (uint32_t)1 << 30; // x^1 reflected.
+	for(k = 1; k < 64; k++) crcx2n[k] = multmodp(crcx2n[k - 1], crcx2n[k - 1]);
+	pfncrc = crc32csw;
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("sse4.2")) pfncrc = crc32chw;
+#endif
+}
+
+uint32_t crc32c(uint32_t dwCRC, const uint8_t *p, size_t n)
+{
+	// CRC-32C (Castagnoli), pass 0 to start and the previous result to continue.
+	pthread_once(&crconce, crc32cinit);
+
+	return ~pfncrc(~dwCRC, p, n);
+}
+
+uint32_t crc32csw(uint32_t c, const uint8_t *p, size_t n)
+{
+	// slicing-by-8 on the unconditioned crc register.
+	uint64_t q;
+
+	while(n && ((uintptr_t)p & 7))
+	{
+		c = crctable[0][(c ^ *p++) & 0xff] ^ (c >> 8);
+		n--;
+	}
+	while(n >= 8)
+	{
+		q = *(const uint64_t *)p ^ c;
+		c = crctable[7][q & 0xff] ^ crctable[6][(q >> 8) & 0xff] ^ crctable[5][(q >> 16) & 0xff] ^ crctable[4][(q >> 24) & 0xff] ^
+		    crctable[3][(q >> 32) & 0xff] ^ crctable[2][(q >> 40) & 0xff] ^ crctable[1][(q >> 48) & 0xff] ^ crctable[0][q >> 56];
+		p += 8;
+		n -= 8;
+	}
+	while(n--) c = crctable[0][(c ^ *p++) & 0xff] ^ (c >> 8);
+
+	return c;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+uint32_t crc32chw(uint32_t c, const uint8_t *p, size_t n)
+{
+	// crc32 instruction on the unconditioned crc register.  Long buffers
+	// run three independent lanes to hide the instruction latency and
+	// are joined with crc32cx8n().
+	uint64_t c0, c1, c2;
+	uint32_t xp;
+	size_t k, i;
+
+	while(n && ((uintptr_t)p & 7))
+	{
+		c = _mm_crc32_u8(c, *p++);
+		n--;
+	}
+	if(n >= CRC_LANES_MIN)
+	{
+		k = (n / 3) & ~(size_t)7;
+		c0 = c;
+		c1 = 0;
+		c2 = 0;
+		for(i = 0; i < k; i += 8)
+		{
+			c0 = _mm_crc32_u64(c0, *(const uint64_t *)(p + i));
+			c1 = _mm_crc32_u64(c1, *(const uint64_t *)(p + k + i));
+			c2 = _mm_crc32_u64(c2, *(const uint64_t *)(p + k + k + i));
+		}
+		xp = crc32cx8n(k);
+		c = multmodp(xp, (uint32_t)c0) ^ (uint32_t)c1;
+		c = multmodp(xp, c) ^ (uint32_t)c2;
+		p += 3 * k;
+		n -= 3 * k;
+	}
+	c0 = c;
+	while(n >= 8)
+	{
+		c0 = _mm_crc32_u64(c0, *(const uint64_t *)p);
+		p += 8;
+		n -= 8;
+	}
+	c = (uint32_t)c0;
+	while(n--) c = _mm_crc32_u8(c, *p++);
+
+	return c;
+}
+#endif
+
+uint32_t multmodp(uint32_t a, uint32_t b)
+{
+	// a * b modulo the reflected crc32c polynomial.
+	uint32_t m = (uint32_t)1 << 31, p = 0;
+
+	for(;;)
+	{
+		if(a & m)
+		{
+			p ^= b;
+			if((a & (m - 1)) == 0) break;
+		}
+		m >>= 1;
+		b = b & 1 ? (b >> 1) ^ 0x82f63b78 : b >> 1;
+	}
+
+	return p;
+}
+
+uint32_t crc32cx8n(uint64_t n)
+{
+	// x^(8n) modulo the crc32c polynomial, multiplying by it advances the
+	// unconditioned crc register over n zero bytes.
+	uint32_t xp = (uint32_t)1 << 31; // x^0 reflected.
+	int k = 3;
+
+	while(n)
+	{
+		if(n & 1) xp = multmodp(crcx2n[k & 63], xp);
+		n >>= 1;
+		k++;
+	}
+
+	return xp;
+}
+
+uint32_t crc32ccombine(uint32_t dwCRC1, uint32_t dwCRC2, uint64_t n2)
+{
+	// crc32c of A followed by B from the crc32c of each, n2 the length of B.
+	pthread_once(&crconce, crc32cinit);
+
+	return multmodp(crc32cx8n(n2), dwCRC1) ^ dwCRC2;
+}
+
+uint8_t rowspread[3][3][16], rowgather[3][3][16], rowkeep[3][16]; // SIMD kernel masks, built by rowinit().
+void (*pfnembed)(uint8_t *pC, const uint8_t *pData, int n); // selected by rowinit().
+void (*pfnextract)(const uint8_t *pC, uint8_t *pData, int n);
+pthread_once_t rowonce = PTHREAD_ONCE_INIT;
+const ROWKERNEL rowkernels[] = // reference first, then faster kernels in order of preference.
+{
+	{ "scalar", embedrowsw, extractrowsw, hasscalar },
+#if defined(__x86_64__)
+	{ "ssse3", embedrowssse3, extractrowssse3, hasssse3 },
+#endif
+};
+
+void embedrow(uint8_t *pC, const uint8_t *pData, int n)
+{
+	// stores n bytes into the low-order bits of n BGR pixels, 3-2-3 bits.
+	if(n < ROW_SIMD_MIN)
+	{
+		embedrowsw(pC, pData, n);
+
+		return;
+	}
+	pthread_once(&rowonce, rowinit);
+	pfnembed(pC, pData, n);
+}
+
+void extractrow(const uint8_t *pC, uint8_t *pData, int n)
+{
+	// recovers n bytes from the low-order bits of n BGR pixels.
+	if(n < ROW_SIMD_MIN)
+	{
+		extractrowsw(pC, pData, n);
+
+		return;
+	}
+	pthread_once(&rowonce, rowinit);
+	pfnextract(pC, pData, n);
+}
+
+void embedrowsw(uint8_t *pC, const uint8_t *pData, int n)
+{
+	// the reference kernel, one pixel at a time.
+	uint8_t dibyte;
+
+	while(n--)
+	{
+		dibyte = *pData++;
+		*pC = (*pC & 0xf8) | (dibyte & 0x7);
+		*(pC + 1) = (*(pC + 1) & 0xfc) | ((dibyte >> 3) & 0x3);
+		*(pC + 2) = (*(pC + 2) & 0xf8) | ((dibyte >> 5) & 0x7);
+		pC += 3;
+	}
+}
+
+void extractrowsw(const uint8_t *pC, uint8_t *pData, int n)
+{
+	// the reference kernel, one pixel at a time.
+	while(n--)
+	{
+		*pData++ = (*pC & 0x7) | ((*(pC + 1) & 0x3) << 3) | ((*(pC + 2) & 0x7) << 5);
+		pC += 3;
+	}
+}
+
+void rowinit(void)
+{
+	// shuffle masks of the SIMD kernels, then the fastest kernel this cpu
+	// runs.  Byte j of 16 pixels is channel j % 3 of pixel j / 3.
+	int k, c, t, j;
+
+	for(k = 0; k < 3; k++)
+	{
+		for(c = 0; c < 3; c++)
+		{
+			for(t = 0; t < 16; t++)
+			{
+				j = (k * 16) + t;
+				rowspread[k][c][t] = j % 3 == c ? (uint8_t)(j / 3) : 0x80;
+				j = (t * 3) + c;
+				rowgather[k][c][t] = j / 16 == k ? (uint8_t)(j % 16) : 0x80;
+			}
+		}
+		for(t = 0; t < 16; t++) rowkeep[k][t] = ((k * 16) + t) % 3 == 1 ? 0xfc : 0xf8;
+	}
+	pfnembed = rowkernels[0].pfnEmbed;
+	pfnextract = rowkernels[0].pfnExtract;
+	for(k = 1; k < sizeof(rowkernels) / sizeof(rowkernels[0]); k++)
+	{
+		if(!rowkernels[k].pfnUsable()) continue;
+		pfnembed = rowkernels[k].pfnEmbed;
+		pfnextract = rowkernels[k].pfnExtract;
+	}
+}
+
+#if defined(__x86_64__)
+int hasssse3(void)
+{
+	__builtin_cpu_init();
+
+	return __builtin_cpu_supports("ssse3");
+}
+
+__attribute__((target("ssse3")))
+void embedrowssse3(uint8_t *pC, const uint8_t *pData, int n)
+{
+	// embedrowsw() sixteen pixels at a time, pshufb spreads the three bit
+	// fields of each byte over the BGR bytes of its pixel.
+	__m128i s[3][3], keep[3], m7 = _mm_set1_epi8(7), m3 = _mm_set1_epi8(3), d, b, g, r, x;
+	uint8_t *p;
+	int i, k, c;
+
+	for(k = 0; k < 3; k++)
+	{
+		for(c = 0; c < 3; c++) s[k][c] = _mm_loadu_si128((const __m128i *)rowspread[k][c]);
+		keep[k] = _mm_loadu_si128((const __m128i *)rowkeep[k]);
+	}
+	for(i = 0; i + 16 <= n; i += 16)
+	{
+		d = _mm_loadu_si128((const __m128i *)(pData + i));
+		b = _mm_and_si128(d, m7);
+		g = _mm_and_si128(_mm_srli_epi16(d, 3), m3);
+		r = _mm_and_si128(_mm_srli_epi16(d, 5), m7);
+		for(k = 0; k < 3; k++)
+		{
+			p = pC + (i * 3) + (k * 16);
+			x = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, s[k][0]), _mm_shuffle_epi8(g, s[k][1])), _mm_shuffle_epi8(r, s[k][2]));
+			_mm_storeu_si128((__m128i *)p, _mm_or_si128(_mm_and_si128(_mm_loadu_si128((const __m128i *)p), keep[k]), x));
+		}
+	}
+	embedrowsw(pC + (i * 3), pData + i, n - i);
+}
+
+__attribute__((target("ssse3")))
+void extractrowssse3(const uint8_t *pC, uint8_t *pData, int n)
+{
+	// extractrowsw() sixteen pixels at a time, pshufb gathers each
+	// channel of the 48 BGR bytes.
+	__m128i s[3][3], m7 = _mm_set1_epi8(7), m3 = _mm_set1_epi8(3), x[3], v[3];
+	int i, k, c;
+
+	for(k = 0; k < 3; k++)
+	{
+		for(c = 0; c < 3; c++) s[k][c] = _mm_loadu_si128((const __m128i *)rowgather[k][c]);
+	}
+	for(i = 0; i + 16 <= n; i += 16)
+	{
+		for(k = 0; k < 3; k++) x[k] = _mm_loadu_si128((const __m128i *)(pC + (i * 3) + (k * 16)));
+		for(c = 0; c < 3; c++) v[c] = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(x[0], s[0][c]), _mm_shuffle_epi8(x[1], s[1][c])), _mm_shuffle_epi8(x[2], s[2][c]));
+		v[0] = _mm_and_si128(v[0], m7);
+		v[1] = _mm_slli_epi16(_mm_and_si128(v[1], m3), 3);
+		v[2] = _mm_slli_epi16(_mm_and_si128(v[2], m7), 5);
+		_mm_storeu_si128((__m128i *)(pData + i), _mm_or_si128(_mm_or_si128(v[0], v[1]), v[2]));
+	}
+	extractrowsw(pC + (i * 3), pData + i, n - i);
+}
+#endif
+
+int hasscalar(void)
+{
+	return 1;
+}
+
+void fillrow(uint8_t *pC, int n, int nRF)
+{
+	// inserts random bits into n unused pixels, see encode().
+	uint8_t dibyte;
+
+	if(!nRF) return;
+	while(n--)
+	{
+		dibyte = fillbyte(nRF);
+		embedrow(pC, &dibyte, 1);
+		pC += 3;
+	}
+}
+
+uint8_t fillbyte(int nRF)
+{
+	// random bits for one unused pixel.
+	uint8_t dibyte, mask = 0x29; // B_G_R encoding mask in binary = 001_01_001
+                                     // white = 0xffffff, black = 0x000000
+
+	dibyte = (uint8_t)rand();
+	if(nRF == 2) dibyte &= mask; // darken (more 0s)
+	if(nRF == 3) dibyte |= ~mask; // lighten (more 1s)
+
+	return dibyte;
+}
+
+void initsrc(PDATASRC ds, uint8_t *pPrefix, int nPrefix, PMEMBER pMembers, int nMembers)
+{
+	// payload stream of pPrefix followed by the data of each member.
+	ds->pPrefix = pPrefix;
+	ds->nPrefix = nPrefix;
+	ds->nPos = 0;
+	ds->pMembers = pMembers;
+	ds->nMembers = nMembers;
+	ds->nMember = 0;
+	ds->dwLeft = nMembers ? pMembers[0].dwLength : 0;
+	ds->bCipher = 0;
+	ds->nHdr = 0;
+	ds->qwPos = 0;
+	ds->pLz = NULL;
+	ds->qwBody = 0;
+	ds->pFec = NULL;
+	ds->qwCoded = 0;
+	ds->pPerm = NULL;
+	ds->pMask = NULL;
+	ds->pAdapt = NULL;
+	ds->pCover = NULL;
+	ds->pGen = NULL;
+	ds->pCkpt = NULL;
+	ds->nRow0 = 0;
+}
+
+int readsrc(PDATASRC ds, uint8_t *p, int n)
+{
+	// reads up to n payload bytes, returns fewer only at the end of the
+	// payload and -1 on error.  The header bytes of the prefix are passed
+	// as they are, the body comes from readcoded() or its slots.
+	int nRead = 0, k;
+
+	if(ds->nPos < ds->nHdr)
+	{
+		k = ds->nHdr - ds->nPos;
+		if(k > n) k = n;
+		memcpy(p, ds->pPrefix + ds->nPos, k);
+		if(ds->pPerm) memset(ds->pMask, 1, k);
+		ds->nPos += k;
+		nRead += k;
+	}
+	if(ds->pPerm) k = permsrc(ds, p + nRead, ds->pMask + nRead, n - nRead);
+	else k = readcoded(ds, p + nRead, n - nRead);
+	if(k < 0) return -1;
+	nRead += k;
+	ds->qwPos += nRead;
+
+	return nRead;
+}
+
+int readbody(PDATASRC ds, uint8_t *p, int n)
+{
+	// reads up to n body bytes, the rest of the prefix followed by the
+	// member data through any compression stage, encrypted as read.
+	int nRead = 0, k;
+
+	if(ds->nPos < ds->nPrefix)
+	{
+		k = ds->nPrefix - ds->nPos;
+		if(k > n) k = n;
+		memcpy(p, ds->pPrefix + ds->nPos, k);
+		ds->nPos += k;
+		nRead += k;
+	}
+	if((k = ds->pLz ? lzread(ds, p + nRead, n - nRead) : readmembers(ds, p + nRead, n - nRead)) < 0) return -1;
+	nRead += k;
+	// crcs are of the plaintext.
+	if(ds->bCipher) chacha20xor(&ds->ci, ds->qwBody, p, nRead);
+	ds->qwBody += nRead;
+
+	return nRead;
+}
+
+int readmembers(PDATASRC ds, uint8_t *p, int n)
+{
+	// reads up to n bytes of member data.  Member files are opened when
+	// reached and must hold exactly the number of bytes planned for them.
+	int nRead = 0, k;
+	PMEMBER pm;
+
+	while(nRead < n && ds->nMember < ds->nMembers)
+	{
+		pm = &ds->pMembers[ds->nMember];
+		if(ds->dwLeft == 0)
+		{
+			// current member complete.
+			if(pm->pPath && pm->fIn) { fclose(pm->fIn); pm->fIn = NULL; }
+			if(++ds->nMember < ds->nMembers) ds->dwLeft = ds->pMembers[ds->nMember].dwLength;
+			continue;
+		}
+		if(pm->fIn == NULL && (pm->fIn = fopenpath(pm->pPath, "rb")) == NULL) return -1;
+		k = n - nRead;
+		if(k > ds->dwLeft) k = ds->dwLeft;
+		if(fread(p + nRead, 1, k, pm->fIn) != k) return -1;
+		pm->dwCRC = crc32c(pm->dwCRC, p + nRead, k);
+		ds->dwLeft -= k;
+		nRead += k;
+	}
+
+	return nRead;
+}
+
+void closesrc(PDATASRC ds)
+{
+	// closes member files opened by readsrc().
+	int i;
+
+	for(i = 0; i < ds->nMembers; i++)
+	{
+		if(ds->pMembers[i].pPath && ds->pMembers[i].fIn)
+		{
+			fclose(ds->pMembers[i].fIn);
+			ds->pMembers[i].fIn = NULL;
+		}
+	}
+}
+
+void pxinit(PPIXRDR pr, FILE *fBMPin, char *pBMPbufin, HDRCHECK hc)
+{
+	// fBMPin at start of image data in <bmp in>.
+	pr->fBMPin = fBMPin;
+	pr->hc = hc;
+	pr->pRow = (uint8_t *)pBMPbufin;
+	pr->lData = ftello(fBMPin);
+	pr->nLoaded = -1;
+	pr->nRow = 0;
+	pr->nCol = 0;
+	pr->bCipher = 0;
+	pr->dwBody = 0;
+	pr->nFecparity = 0;
+	pr->nFecdepth = 0;
+	pr->dwFecleft = 0;
+	pr->pFec = NULL;
+	pr->bPerm = 0;
+	pr->dwPlan = 0;
+	pr->pPerm = NULL;
+	pr->bAdapt = 0;
+	pr->pAdapt = NULL;
+	pr->pCkpt = NULL;
+}
+
+int pxload(PPIXRDR pr, int nRow)
+{
+	// makes nRow the scan line in pRow, seeking only when not sequential.
+	if(nRow == pr->nLoaded) return 0;
+	if(nRow != pr->nLoaded + 1)
+	{
+		if(fseeko(pr->fBMPin, pr->lData + (off_t)nRow * pr->hc.nStride, SEEK_SET)) return -1;
+	}
+	if(fread(pr->pRow, 1, pr->hc.nStride, pr->fBMPin) != pr->hc.nStride) return -2;
+	pr->nLoaded = nRow;
+	statlap(STAT_COVER, pr->hc.nStride);
+	PROBE2(row_read, nRow, pr->hc.nStride);
+
+	return 0;
+}
+
+int pxseek(PPIXRDR pr, uint32_t dwPixel)
+{
+	// positions the reader at payload pixel dwPixel, counted from the
+	// bottom lefthand corner.
+	if(dwPixel / pr->hc.nBMPw >= pr->hc.nBMPh) return -1;
+	pr->nRow = dwPixel / pr->hc.nBMPw;
+	pr->nCol = dwPixel % pr->hc.nBMPw;
+
+	return 0;
+}
+
+int pxread(PPIXRDR pr, uint8_t *p, int n)
+{
+	// extracts the next n payload bytes, through the fec stage once the
+	// header has been read.
+	return pr->nFecparity ? pxfec(pr, p, n) : pxextract(pr, p, n);
+}
+
+int pxextract(PPIXRDR pr, uint8_t *p, int n)
+{
+	// extracts the next n bytes as embedded, gathered from their slots
+	// and decrypted unless there is parity to check first.
+	uint32_t dwPixel;
+	int nSkip;
+
+	if(pr->bPerm) return pxperm(pr, p, n);
+	if(pr->bAdapt) return pxadapt(pr, p, n);
+	dwPixel = (uint32_t)pr->nRow * pr->hc.nBMPw + pr->nCol;
+	if(pxraw(pr, p, n)) return -1;
+	if(pr->bCipher && !pr->nFecparity && dwPixel + n > pr->dwBody)
+	{
+		nSkip = dwPixel < pr->dwBody ? (int)(pr->dwBody - dwPixel) : 0;
+		chacha20xor(&pr->ci, dwPixel + nSkip - pr->dwBody, p + nSkip, n - nSkip);
+	}
+
+	return 0;
+}
+
+int pxraw(PPIXRDR pr, uint8_t *p, int n)
+{
+	// extracts the next n bytes of pixels in order.
+	int k;
+
+	while(n > 0)
+	{
+		if(pr->nCol == pr->hc.nBMPw)
+		{
+			pr->nRow++;
+			pr->nCol = 0;
+		}
+		if(pr->nRow >= pr->hc.nBMPh) return -1;
+		if(pxload(pr, pr->nRow)) return -2;
+		k = pr->hc.nBMPw - pr->nCol;
+		if(k > n) k = n;
+		extractrow(pr->pRow + (pr->nCol * 3), p, k);
+		statlap(STAT_TRANSFORM, k * 3);
+		PROBE2(row_transform, pr->nRow, k);
+		pr->nCol += k;
+		p += k;
+		n -= k;
+	}
+
+	return 0;
+}
+
+void pxclose(PPIXRDR pr)
+{
+	// frees the fec, permutation and texture stages.
+	fecfree(pr->pFec);
+	bigfree(pr->pPerm);
+	free(pr->pAdapt);
+	pr->pFec = NULL;
+	pr->pPerm = NULL;
+	pr->pAdapt = NULL;
+}
+
+int pxcopy(PPIXRDR pr, uint32_t dwLength, FILE *fFileout, uint32_t *pdwCRC)
+{
+	// extracts dwLength payload bytes to fFileout, and their crc32c when
+	// pdwCRC is not NULL.  A NULL fFileout only checks the bytes.
+	uint8_t buf[BUF_SIZE];
+	int k;
+
+	if(pdwCRC) *pdwCRC = pr->pCkpt ? pr->pCkpt->dwCRC : 0;
+	while(dwLength)
+	{
+		k = dwLength < BUF_SIZE ? dwLength : BUF_SIZE;
+		if(pxread(pr, buf, k)) return -1;
+		if(pdwCRC) *pdwCRC = crc32c(*pdwCRC, buf, k);
+		statlap(STAT_PAYLOAD, k);
+		if(fFileout && fwrite(buf, 1, k, fFileout) != k) return -2;
+		if(pr->pCkpt && ckptdata(pr->pCkpt, buf, k, pdwCRC ? *pdwCRC : 0)) return -2;
+		statlap(STAT_WRITE, k);
+		PROBE1(data_write, k);
+		dwLength -= k;
+	}
+
+	return 0;
+}
+
+void putle(uint8_t *p, uint64_t v, int n)
+{
+	// stores the low n bytes of v, little-endian.
+	while(n--)
+	{
+		*p++ = (uint8_t)v;
+		v >>= 8;
+	}
+}
+
+uint64_t getle(const uint8_t *p, int n)
+{
+	// loads n little-endian bytes.
+	uint64_t v = 0;
+
+	while(n--) v = (v << 8) | p[n];
+
+	return v;
+}
+
+int putexthdr(PEXTHDR eh, uint8_t *p)
+{
+	// builds the zero length pixels and the extended header in p, returns
+	// the number of payload bytes used.  Optional fields follow the fixed
+	// header in the order of their flag bits.
+	uint8_t *h = eh->bRaw;
+
+	eh->nHdrlen = EXT_HDR_MIN;
+	if(eh->wFlags & EXT_FLAG_SHARD)
+	{
+		putle(h + eh->nHdrlen, eh->dwSetid, 4);
+		putle(h + eh->nHdrlen + 4, eh->wSeq, 2);
+		putle(h + eh->nHdrlen + 6, eh->wShards, 2);
+		putle(h + eh->nHdrlen + 8, eh->qwOffset, 8);
+		putle(h + eh->nHdrlen + 16, eh->qwTotal, 8);
+		eh->nHdrlen += EXT_SHARD_LEN;
+	}
+	if(eh->wFlags & EXT_FLAG_CRC)
+	{
+		putle(h + eh->nHdrlen, eh->dwCRC, 4);
+		eh->nHdrlen += EXT_CRC_LEN;
+	}
+	if(eh->wFlags & EXT_FLAG_CHACHA)
+	{
+		memcpy(h + eh->nHdrlen, eh->bNonce, EXT_NONCE_LEN);
+		eh->nHdrlen += EXT_NONCE_LEN;
+	}
+	if(eh->wFlags & EXT_FLAG_LZ)
+	{
+		putle(h + eh->nHdrlen, eh->dwRaw, 4);
+		eh->nHdrlen += EXT_LZ_LEN;
+	}
+	if(eh->wFlags & EXT_FLAG_FEC)
+	{
+		h[eh->nHdrlen] = (uint8_t)eh->nFecparity;
+		h[eh->nHdrlen + 1] = (uint8_t)eh->nFecdepth;
+		eh->nHdrlen += EXT_FEC_LEN;
+	}
+	if(eh->wFlags & EXT_FLAG_PERM)
+	{
+		putle(h + eh->nHdrlen, eh->dwPlan, 4);
+		eh->nHdrlen += EXT_PERM_LEN;
+	}
+	h[0] = 'B';
+	h[1] = 'S';
+	h[2] = EXT_VERSION;
+	h[3] = (uint8_t)eh->nHdrlen;
+	putle(h + 4, eh->wFlags, 2);
+	putle(h + 6, eh->dwLength, 4);
+	memset(p, 0, FILE_SIZE_PIXELS);
+	memcpy(p + FILE_SIZE_PIXELS, h, eh->nHdrlen);
+
+	return FILE_SIZE_PIXELS + eh->nHdrlen;
+}
+
+int readpayloadhdr(PPIXRDR pr, PEXTHDR eh)
+{
+	// reads the length pixels and any extended header.  Leaves the reader
+	// at the first byte of the body.
+	uint8_t *h = eh->bRaw;
+	uint8_t dfs[FILE_SIZE_PIXELS];
+	uint64_t qwCap;
+	int n;
+
+	memset(eh, 0, sizeof(EXTHDR));
+	if(pxread(pr, dfs, FILE_SIZE_PIXELS)) return -1;
+	eh->dwLength = (uint32_t)getle(dfs, FILE_SIZE_PIXELS);
+	if(eh->dwLength == 0)
+	{
+		if(pxread(pr, h, 4)) return -2;
+		if(h[0] != 'B' || h[1] != 'S' || h[2] != EXT_VERSION || h[3] < EXT_HDR_MIN) return -3;
+		eh->nHdrlen = h[3];
+		if(pxread(pr, h + 4, eh->nHdrlen - 4)) return -4;
+		eh->wFlags = (uint16_t)getle(h + 4, 2);
+		eh->dwLength = (uint32_t)getle(h + 6, 4);
+		if(eh->wFlags & ~EXT_FLAGS_KNOWN) return -5;
+		n = EXT_HDR_MIN;
+		if(eh->wFlags & EXT_FLAG_SHARD)
+		{
+			if(n + EXT_SHARD_LEN > eh->nHdrlen) return -7;
+			eh->dwSetid = (uint32_t)getle(h + n, 4);
+			eh->wSeq = (uint16_t)getle(h + n + 4, 2);
+			eh->wShards = (uint16_t)getle(h + n + 6, 2);
+			eh->qwOffset = getle(h + n + 8, 8);
+			eh->qwTotal = getle(h + n + 16, 8);
+			n += EXT_SHARD_LEN;
+			if(eh->wSeq >= eh->wShards || eh->qwOffset > eh->qwTotal || eh->dwLength > eh->qwTotal - eh->qwOffset) return -7;
+		}
+		if(eh->wFlags & EXT_FLAG_CRC)
+		{
+			if(n + EXT_CRC_LEN > eh->nHdrlen) return -7;
+			eh->dwCRC = (uint32_t)getle(h + n, 4);
+			n += EXT_CRC_LEN;
+		}
+		if(eh->wFlags & EXT_FLAG_CHACHA)
+		{
+			if(n + EXT_NONCE_LEN > eh->nHdrlen) return -7;
+			memcpy(eh->bNonce, h + n, EXT_NONCE_LEN);
+			n += EXT_NONCE_LEN;
+		}
+		if(eh->wFlags & EXT_FLAG_LZ)
+		{
+			// archive offsets and shard ranges are of the embedded body.
+			if(n + EXT_LZ_LEN > eh->nHdrlen || (eh->wFlags & (EXT_FLAG_ARCHIVE | EXT_FLAG_SHARD))) return -7;
+			eh->dwRaw = (uint32_t)getle(h + n, 4);
+			n += EXT_LZ_LEN;
+		}
+		if(eh->wFlags & EXT_FLAG_FEC)
+		{
+			if(n + EXT_FEC_LEN > eh->nHdrlen || (eh->wFlags & (EXT_FLAG_ARCHIVE | EXT_FLAG_SHARD))) return -7;
+			eh->nFecparity = h[n];
+			eh->nFecdepth = h[n + 1];
+			n += EXT_FEC_LEN;
+			if(eh->nFecparity < FEC_MIN_PARITY || eh->nFecparity > FEC_MAX_PARITY || eh->nFecdepth < 1 || eh->nFecdepth > FEC_DEPTH) return -7;
+		}
+		if(eh->wFlags & EXT_FLAG_PERM)
+		{
+			// the placement is keyed by the cipher key and nonce.
+			if(n + EXT_PERM_LEN > eh->nHdrlen || (eh->wFlags & (EXT_FLAG_ARCHIVE | EXT_FLAG_SHARD)) || !(eh->wFlags & EXT_FLAG_CHACHA)) return -7;
+			eh->dwPlan = (uint32_t)getle(h + n, 4);
+			n += EXT_PERM_LEN;
+		}
+		// bytes per pixel vary, so nothing can seek into the body.
+		if((eh->wFlags & EXT_FLAG_ADAPT) && (eh->wFlags & (EXT_FLAG_ARCHIVE | EXT_FLAG_SHARD | EXT_FLAG_PERM))) return -7;
+	}
+	// a cover too small for the header holds no body at all.
+	qwCap = (uint64_t)pr->hc.nBMPw * pr->hc.nBMPh;
+	if(qwCap < FILE_SIZE_PIXELS + eh->nHdrlen) return -6;
+	qwCap -= FILE_SIZE_PIXELS + eh->nHdrlen;
+	if(qwCap < eh->dwLength) return -6;
+	if(eh->wFlags & EXT_FLAG_PERM)
+	{
+		if(eh->dwPlan < eh->dwLength || eh->dwPlan > qwCap) return -7;
+		pr->bPerm = 1;
+		pr->dwPlan = eh->dwPlan;
+	}
+	pr->bAdapt = (eh->wFlags & EXT_FLAG_ADAPT) != 0;
+	eh->dwData = eh->dwLength;
+	if(eh->wFlags & EXT_FLAG_FEC)
+	{
+		// every stripe, the last one included, ends with its parity rows.
+		n = eh->dwLength % (FEC_N * eh->nFecdepth);
+		if(n && n <= eh->nFecparity * eh->nFecdepth) return -7;
+		eh->dwData -= (eh->dwLength / (FEC_N * eh->nFecdepth) + (n != 0)) * eh->nFecparity * eh->nFecdepth;
+		pr->nFecparity = eh->nFecparity;
+		pr->nFecdepth = eh->nFecdepth;
+		pr->dwFecleft = eh->dwLength;
+	}
+
+	return pxcipher(pr, eh);
+}
+
+int putindex(PMEMBER pMembers, int nMembers, uint8_t *p)
+{
+	// builds the archive index in p, returns its size in bytes.
+	uint8_t *q = p;
+	PMEMBER pm;
+	int i, k;
+
+	*q++ = (uint8_t)nMembers;
+	*q++ = (uint8_t)(nMembers >> 8);
+	for(i = 0; i < nMembers; i++)
+	{
+		pm = &pMembers[i];
+		k = strlen(pm->szName);
+		*q++ = (uint8_t)k;
+		memcpy(q, pm->szName, k);
+		q += k;
+		putle(q, pm->dwOffset, 4);
+		putle(q + 4, pm->dwLength, 4);
+		putle(q + 8, pm->dwCRC, 4);
+		q += 12;
+	}
+
+	return q - p;
+}
+
+int readindex(PPIXRDR pr, PEXTHDR eh, PMEMBER pm)
+{
+	// reads the next archive index entry into pm.
+	uint8_t b[IDX_ENTRY_FIXED - 1];
+	uint8_t k;
+
+	memset(pm, 0, sizeof(MEMBER));
+	if(pxread(pr, &k, 1)) return -1;
+	if(pxread(pr, (uint8_t *)pm->szName, k)) return -2;
+	if(pxread(pr, b, sizeof(b))) return -3;
+	pm->dwOffset = (uint32_t)getle(b, 4);
+	pm->dwLength = (uint32_t)getle(b + 4, 4);
+	pm->dwCRC = (uint32_t)getle(b + 8, 4);
+	if(pm->dwOffset > eh->dwLength || pm->dwLength > eh->dwLength - pm->dwOffset) return -4;
+
+	return 0;
+}
+
+int patchbytes(FILE *fFileout, HDRCHECK hc, uint32_t dwPixel, const uint8_t *p, uint32_t n, uint8_t *pRow)
+{
+	// re-embeds n bytes at payload pixel dwPixel of an already written
+	// <bmp out>, rewriting only the scan lines they fall in.
+	off_t lRow;
+	int k;
+
+	while(n)
+	{
+		lRow = (off_t)hc.nOffset + (off_t)(dwPixel / hc.nBMPw) * hc.nStride;
+		k = hc.nBMPw - (dwPixel % hc.nBMPw);
+		if(k > n) k = n;
+		if(fseeko(fFileout, lRow, SEEK_SET)) return -1;
+		if(fread(pRow, 1, hc.nStride, fFileout) != hc.nStride) return -2;
+		embedrow(pRow + ((dwPixel % hc.nBMPw) * 3), p, k);
+		if(fseeko(fFileout, lRow, SEEK_SET)) return -3;
+		if(fwrite(pRow, 1, hc.nStride, fFileout) != hc.nStride) return -4;
+		dwPixel += k;
+		p += k;
+		n -= k;
+	}
+
+	return 0;
+}
+
+FILE *openbmp(char *pBMPin, char *pBMPbufhdrin, int *pnFS1)
+{
+	// opens <bmp in> and reads its headers into pBMPbufhdrin, leaving the
+	// file at the start of the image data.  Sized from its descriptor
+	// as main() does, past INT32_MAX it has no size.
+	struct stat st;
+	FILE *fBMPin;
+
+	*pnFS1 = 0;
+	if((fBMPin = fopenpath(pBMPin, "rb")) != NULL && fstat(fileno(fBMPin), &st) == 0 && st.st_size <= INT32_MAX && fseeko(fBMPin, 0, SEEK_SET) == 0)
+	{
+		*pnFS1 = (int)st.st_size;
+	}
+	if(*pnFS1 < 1)
+	{
+		fprintf(stderr, "ERROR: could not get size of <bmp in>.\n");
+		if(fBMPin) fclose(fBMPin);
+
+		return NULL;
+	}
+	if(*pnFS1 < (sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + MIN_DATA))
+	{
+		fprintf(stderr, "ERROR: bad file size.\n");
+		fclose(fBMPin);
+
+		return NULL;
+	}
+	if(fread(pBMPbufhdrin, 1, sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER), fBMPin) != sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER))
+	{
+		fprintf(stderr, "ERROR: unable to read <bmp in> headers.\n");
+		fclose(fBMPin);
+
+		return NULL;
+	}
+	// the archive, shard and verify commands read BMP covers only.
+	if(pBMPbufhdrin[0] != 'B' || pBMPbufhdrin[1] != 'M')
+	{
+		fprintf(stderr, "ERROR: <bmp in> is not a BMP, only e, d and update take PPM, PAM and --raw covers.\n");
+		fclose(fBMPin);
+
+		return NULL;
+	}
+
+	return fBMPin;
+}
+
+int cmpmember(const void *a, const void *b)
+{
+	return strcmp((*(PMEMBER *)a)->szName, (*(PMEMBER *)b)->szName);
+}
+
+int cmdpack(int argc, char **argv)
+{
+	// pack <bmp in> <bmp out> <fill> <member in>...
+	int nFS1, nRF, nMembers, nIndex, nPrefix, i, k, e, ret = -1;
+	uint64_t qwBody;
+	char *pBMPin, *pFileout;
+	char pBMPbufhdrin[sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER)];
+	char *pBMPbufin = NULL, *pDatabufin = NULL;
+	uint8_t *pPrefix = NULL;
+	FILE *fBMPin = NULL, *fFileout = NULL;
+	PMEMBER pMembers = NULL, *ppSorted = NULL;
+	struct stat st;
+	EXTHDR eh;
+	DATASRC ds;
+	HDRCHECK hc;
+
+	if(argc < 6 || (nRF = fillmode(argv[4])) < 0) { usage(); return -1; }
+	pBMPin = argv[2];
+	pFileout = argv[3];
+	nMembers = argc - 5;
+	if(nMembers > MAX_MEMBERS)
+	{
+		fprintf(stderr, "ERROR: too many members, max %d.\n", MAX_MEMBERS);
+
+		return -1;
+	}
+	if(!strcmp(pBMPin, pFileout))
+	{
+		fprintf(stderr, "ERROR: overlapping file names.\n");
+
+		return -1;
+	}
+	if((pMembers = (PMEMBER)calloc(nMembers, sizeof(MEMBER))) == NULL || (ppSorted = (PMEMBER *)malloc(nMembers * sizeof(PMEMBER))) == NULL)
+	{
+		fprintf(stderr, "ERROR: unable to allocate archive index.\n");
+		goto cleanup;
+	}
+	// size the index and lay out the member data after it.
+	nIndex = 2;
+	for(i = 0; i < nMembers; i++)
+	{
+		pMembers[i].pPath = argv[i + 5];
+		if(!strcmp(pMembers[i].pPath, pBMPin) || !strcmp(pMembers[i].pPath, pFileout))
+		{
+			fprintf(stderr, "ERROR: overlapping file names.\n");
+			goto cleanup;
+		}
+		if(strlen(pMembers[i].pPath) > MAX_MEMBER_NAME)
+		{
+			fprintf(stderr, "ERROR: member name longer than %d, %s.\n", MAX_MEMBER_NAME, pMembers[i].pPath);
+			goto cleanup;
+		}
+		if(statpath(pMembers[i].pPath, &st) || !S_ISREG(st.st_mode) || st.st_size > UINT32_MAX)
+		{
+			fprintf(stderr, "ERROR: could not get size of <member in> %s.\n", pMembers[i].pPath);
+			goto cleanup;
+		}
+		strcpy(pMembers[i].szName, pMembers[i].pPath);
+		pMembers[i].dwLength = (uint32_t)st.st_size;
+		nIndex += IDX_ENTRY_FIXED + strlen(pMembers[i].szName);
+		ppSorted[i] = &pMembers[i];
+	}
+	qsort(ppSorted, nMembers, sizeof(PMEMBER), cmpmember);
+	for(i = 1; i < nMembers; i++)
+	{
+		if(!strcmp(ppSorted[i - 1]->szName, ppSorted[i]->szName))
+		{
+			fprintf(stderr, "ERROR: duplicate member name %s.\n", ppSorted[i]->szName);
+			goto cleanup;
+		}
+	}
+	qwBody = nIndex;
+	for(i = 0; i < nMembers; i++)
+	{
+		pMembers[i].dwOffset = (uint32_t)qwBody;
+		qwBody += pMembers[i].dwLength;
+		if(qwBody > INT32_MAX - FILE_SIZE_PIXELS - 255)
+		{
+			fprintf(stderr, "ERROR: bad file size.\n");
+			goto cleanup;
+		}
+	}
+	// the headers and index are embedded first, crcs are patched in once
+	// the member data has been read.
+	memset(&eh, 0, sizeof(eh));
+	eh.wFlags = EXT_FLAG_ARCHIVE | EXT_FLAG_CRC;
+	eh.dwLength = (uint32_t)qwBody;
+	if(opts.bHaskey && newnonce(&eh))
+	{
+		fprintf(stderr, "ERROR: unable to generate a nonce.\n");
+		goto cleanup;
+	}
+	if((pPrefix = (uint8_t *)malloc(FILE_SIZE_PIXELS + sizeof(eh.bRaw) + nIndex)) == NULL)
+	{
+		fprintf(stderr, "ERROR: unable to allocate archive index.\n");
+		goto cleanup;
+	}
+	nPrefix = putexthdr(&eh, pPrefix);
+	nPrefix += putindex(pMembers, nMembers, pPrefix + nPrefix);
+	if((fBMPin = openbmp(pBMPin, pBMPbufhdrin, &nFS1)) == NULL) goto cleanup;
+	hc = validateheader(pBMPbufhdrin, nFS1, eh.nHdrlen + (int)qwBody, 0);
+	if(hc.nValid != HDR_CHECKE_PASS)
+	{
+		fprintf(stderr, "ERROR: <bmp in> header check failed (%08X).\n", hc.dwFlags);
+		goto cleanup;
+	}
+	if((pBMPbufin = (char *)malloc(BUF_SIZE)) == NULL || (pDatabufin = (char *)malloc(BUF_SIZE)) == NULL)
+	{
+		fprintf(stderr, "ERROR: unable to allocate buffer for <bmp in> data.\n");
+		goto cleanup;
+	}
+	if((fFileout = fopenpath(pFileout, "wb+")) == NULL)
+	{
+		fprintf(stderr, "ERROR: unable to open <bmp out>.\n");
+		goto cleanup;
+	}
+	if(fwrite(pBMPbufhdrin, 1, sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER), fFileout) != sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER))
+	{
+		fprintf(stderr, "ERROR: unable to write <bmp out> header.\n");
+		goto cleanup;
+	}
+	initsrc(&ds, pPrefix, nPrefix, pMembers, nMembers);
+	srccipher(&ds, &eh);
+	e = encode(fBMPin, fFileout, pBMPbufin, pDatabufin, hc, &ds, nRF);
+	closesrc(&ds);
+	if(e == 0)
+	{
+		// the body crc covers the final plaintext index, which is then
+		// encrypted in place when a key is given.
+		i = FILE_SIZE_PIXELS + eh.nHdrlen;
+		k = putindex(pMembers, nMembers, pPrefix + i);
+		if((e = patchhdr(fFileout, hc, &eh, &ds, (uint8_t *)pBMPbufin)) == 0)
+		{
+			if(ds.bCipher) chacha20xor(&ds.ci, 0, pPrefix + i, k);
+			e = patchbytes(fFileout, hc, i, pPrefix + i, k, (uint8_t *)pBMPbufin);
+		}
+	}
+	if(e != 0)
+	{
+		fprintf(stderr, "ERROR: unable to encode <bmp out> file, code %d.\n", e);
+		goto cleanup;
+	}
+	ret = 0;
+
+cleanup:
+	if(fBMPin) fclose(fBMPin);
+	if(fFileout)
+	{
+		if(fclose(fFileout) && ret == 0)
+		{
+			fprintf(stderr, "ERROR: unable to write <bmp out>.\n");
+			ret = -1;
+		}
+		if(ret) removepath(pFileout);
+	}
+	free(pMembers);
+	free(ppSorted);
+	free(pPrefix);
+	free(pBMPbufin);
+	free(pDatabufin);
+
+	return ret;
+}
+
+int openarchive(char *pBMPin, FILE **pfBMPin, char **ppBMPbufin, PPIXRDR pr, PEXTHDR eh)
+{
+	// opens an archive <bmp in> for list and extract, leaves pr at the
+	// first index entry and returns the member count.
+	char pBMPbufhdrin[sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER)];
+	uint8_t b[2];
+	int nFS1, e;
+	HDRCHECK hc;
+
+	if((*pfBMPin = openbmp(pBMPin, pBMPbufhdrin, &nFS1)) == NULL) return -1;
+	hc = validateheader(pBMPbufhdrin, nFS1, 0, 1);
+	if(hc.nValid != HDR_CHECKD_PASS)
+	{
+		fprintf(stderr, "ERROR: <bmp in> header check failed (%08X).\n", hc.dwFlags);
+
+		return -1;
+	}
+	if((*ppBMPbufin = (char *)malloc(BUF_SIZE)) == NULL)
+	{
+		fprintf(stderr, "ERROR: unable to allocate buffer for <bmp in> data.\n");
+
+		return -1;
+	}
+	pxinit(pr, *pfBMPin, *ppBMPbufin, hc);
+	if((e = readpayloadhdr(pr, eh)) != 0)
+	{
+		if(e == DEC_KEY) fprintf(stderr, "ERROR: <bmp in> is encrypted, give --key-file or --key-env.\n");
+		else fprintf(stderr, "ERROR: unable to decode <bmp in> header, code %d.\n", e);
+
+		return -1;
+	}
+	if(!(eh->wFlags & EXT_FLAG_ARCHIVE) || eh->dwLength < 2 || pxread(pr, b, 2))
+	{
+		fprintf(stderr, "ERROR: <bmp in> does not hold an archive.\n");
+
+		return -1;
+	}
+
+	return b[0] | (b[1] << 8);
+}
+
+int cmdlist(int argc, char **argv)
+{
+	// list <bmp in>
+	int nMembers, i, ret = -1;
+	char *pBMPbufin = NULL;
+	FILE *fBMPin = NULL;
+	MEMBER m;
+	PIXRDR pr;
+	EXTHDR eh;
+
+	if(argc != 3) { usage(); return -1; }
+	if((nMembers = openarchive(argv[2], &fBMPin, &pBMPbufin, &pr, &eh)) < 0) goto cleanup;
+	for(i = 0; i < nMembers; i++)
+	{
+		if(readindex(&pr, &eh, &m))
+		{
+			fprintf(stderr, "ERROR: archive index is damaged at entry %d.\n", i);
+			goto cleanup;
+		}
+		printf("%10" PRIu32 "  %08" PRIX32 "  %s\n", m.dwLength, m.dwCRC, m.szName);
+	}
+	ret = 0;
+
+cleanup:
+	if(fBMPin) fclose(fBMPin);
+	free(pBMPbufin);
+
+	return ret;
+}
+
+int cmdextract(int argc, char **argv)
+{
+	// extract <bmp in> <member> <data out>
+	int nMembers, i, e, ret = -1;
+	uint32_t dwCRC;
+	char *pBMPbufin = NULL, *pFileout;
+	FILE *fBMPin = NULL, *fFileout = NULL;
+	MEMBER m;
+	PIXRDR pr;
+	EXTHDR eh;
+
+	if(argc != 5) { usage(); return -1; }
+	pFileout = argv[4];
+	if(!strcmp(argv[2], pFileout))
+	{
+		fprintf(stderr, "ERROR: overlapping file names.\n");
+
+		return -1;
+	}
+	if((nMembers = openarchive(argv[2], &fBMPin, &pBMPbufin, &pr, &eh)) < 0) goto cleanup;
+	// scan the index, only the scan lines holding it are read.
+	for(i = 0; i < nMembers; i++)
+	{
+		if(readindex(&pr, &eh, &m))
+		{
+			fprintf(stderr, "ERROR: archive index is damaged at entry %d.\n", i);
+			goto cleanup;
+		}
+		if(!strcmp(m.szName, argv[3])) break;
+	}
+	if(i == nMembers)
+	{
+		fprintf(stderr, "ERROR: no member named %s.\n", argv[3]);
+		goto cleanup;
+	}
+	if((fFileout = fopenpath(pFileout, "wb")) == NULL)
+	{
+		fprintf(stderr, "ERROR: unable to open <data out>.\n");
+		goto cleanup;
+	}
+	// seek straight to the scan line holding the member data.
+	if((e = pxseek(&pr, FILE_SIZE_PIXELS + eh.nHdrlen + m.dwOffset)) != 0 || (e = pxcopy(&pr, m.dwLength, fFileout, &dwCRC)) != 0)
+	{
+		fprintf(stderr, "ERROR: unable to decode <data out> file, code %d.\n", e);
+		goto cleanup;
+	}
+	if(dwCRC != m.dwCRC)
+	{
+		fprintf(stderr, "ERROR: member %s checksum mismatch (%08" PRIX32 ").\n", m.szName, dwCRC);
+		goto cleanup;
+	}
+	ret = 0;
+
+cleanup:
+	if(fBMPin) fclose(fBMPin);
+	if(fFileout)
+	{
+		if(fclose(fFileout) && ret == 0)
+		{
+			fprintf(stderr, "ERROR: unable to write <data out>.\n");
+			ret = -1;
+		}
+		if(ret) removepath(pFileout);
+	}
+	free(pBMPbufin);
+
+	return ret;
+}
+
+void *poolworker(void *p)
+{
+	// takes jobs from the pool until none are left.
+	PWORKPOOL wp = (PWORKPOOL)p;
+	int i;
+
+	pinworker();
+	while((i = __atomic_fetch_add(&wp->nNext, 1, __ATOMIC_RELAXED)) < wp->nJobs)
+	{
+		if(wp->pfnJob(wp->pCtx, i)) __atomic_fetch_add(&wp->nFailed, 1, __ATOMIC_RELAXED);
+	}
+
+	return NULL;
+}
+
+int runpool(int nJobs, uint64_t qwJob, int (*pfnJob)(void *pCtx, int i), void *pCtx)
+{
+	// runs pfnJob for jobs 0 to nJobs - 1 on up to one thread per online
+	// cpu, the calling thread included, and fewer when jobs of qwJob bytes
+	// would not fit --mem-limit.  Returns the number of failed jobs.
+	WORKPOOL wp;
+	pthread_t *pThreads;
+	int nThreads, i, n = 0;
+
+	wp.pfnJob = pfnJob;
+	wp.pCtx = pCtx;
+	wp.nJobs = nJobs;
+	wp.nNext = 0;
+	wp.nFailed = 0;
+	nThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if(nThreads > nJobs) nThreads = nJobs;
+	nThreads = memthreads(nThreads, qwJob);
+	if(nThreads > 1 && (pThreads = (pthread_t *)malloc((nThreads - 1) * sizeof(pthread_t))) != NULL)
+	{
+		for(i = 0; i < nThreads - 1; i++)
+		{
+			if(pthread_create(&pThreads[n], workerattr(), poolworker, &wp) == 0) n++;
+		}
+		poolworker(&wp);
+		for(i = 0; i < n; i++) pthread_join(pThreads[i], NULL);
+		free(pThreads);
+	}
+	else
+	{
+		poolworker(&wp);
+	}
+
+	return wp.nFailed;
+}
+
+int splitjob(void *pCtx, int i)
+{
+	// embeds one shard of <data in> into its cover.
+	PSHARDJOB j = &((PSHARDJOB)pCtx)[i];
+	uint8_t pPrefix[FILE_SIZE_PIXELS + sizeof(j->eh.bRaw)];
+	char *pBMPbufin = NULL, *pDatabufin = NULL;
+	FILE *fDatain = NULL, *fFileout = NULL;
+	MEMBER m;
+	DATASRC ds;
+
+	j->nErr = -1;
+	if((pBMPbufin = (char *)malloc(BUF_SIZE)) == NULL || (pDatabufin = (char *)malloc(BUF_SIZE)) == NULL) goto cleanup;
+	j->nErr = -2;
+	if((fDatain = fopenpath(j->pDatain, "rb")) == NULL || fseeko(fDatain, (off_t)j->eh.qwOffset, SEEK_SET)) goto cleanup;
+	j->nErr = -3;
+	if((fFileout = fopenpath(j->pFileout, "wb+")) == NULL) goto cleanup;
+	j->nErr = -4;
+	if(fwrite(j->pBMPbufhdrin, 1, sizeof(j->pBMPbufhdrin), fFileout) != sizeof(j->pBMPbufhdrin)) goto cleanup;
+	memset(&m, 0, sizeof(m));
+	m.fIn = fDatain;
+	m.dwLength = j->eh.dwLength;
+	initsrc(&ds, pPrefix, putexthdr(&j->eh, pPrefix), &m, 1);
+	srccipher(&ds, &j->eh);
+	if((j->nErr = encode(j->fBMPin, fFileout, pBMPbufin, pDatabufin, j->hc, &ds, j->nRF)) == 0) j->nErr = patchhdr(fFileout, j->hc, &j->eh, &ds, (uint8_t *)pBMPbufin);
+
+cleanup:
+	if(fDatain) fclose(fDatain);
+	if(fFileout && fclose(fFileout) && j->nErr == 0) j->nErr = -5;
+	free(pBMPbufin);
+	free(pDatabufin);
+
+	return j->nErr;
+}
+
+int joinjob(void *pCtx, int i)
+{
+	// extracts one shard into its place in <data out>.
+	PSHARDJOB j = &((PSHARDJOB)pCtx)[i];
+	char *pBMPbufin = NULL;
+	FILE *fFileout = NULL;
+	uint32_t dwCRC;
+	PIXRDR pr;
+
+	j->nErr = -1;
+	if((pBMPbufin = (char *)malloc(BUF_SIZE)) == NULL) goto cleanup;
+	j->nErr = -2;
+	if((fFileout = fopenpath(j->pFileout, "r+b")) == NULL || fseeko(fFileout, (off_t)j->eh.qwOffset, SEEK_SET)) goto cleanup;
+	j->nErr = -3;
+	if(fseeko(j->fBMPin, j->lData, SEEK_SET)) goto cleanup;
+	pxinit(&pr, j->fBMPin, pBMPbufin, j->hc);
+	j->nErr = -4;
+	if(pxcipher(&pr, &j->eh) || pxseek(&pr, FILE_SIZE_PIXELS + j->eh.nHdrlen)) goto cleanup;
+	if((j->nErr = pxcopy(&pr, j->eh.dwLength, fFileout, &dwCRC)) == 0 && (j->eh.wFlags & EXT_FLAG_CRC) && dwCRC != j->eh.dwCRC) j->nErr = DEC_CRC;
+
+cleanup:
+	if(fFileout && fclose(fFileout) && j->nErr == 0) j->nErr = -5;
+	free(pBMPbufin);
+
+	return j->nErr;
+}
+
+int cmdsplit(int argc, char **argv)
+{
+	// split <data in> <fill> <bmp in> <bmp out> [<bmp in> <bmp out>]...
+	int nFS1, nRF, nShards, i, k, nRan = 0, ret = -1;
+	uint64_t qwTotal, qwCap = 0, qwOffset = 0, qwLeft;
+	uint64_t *pqwCap = NULL;
+	uint32_t dwSetid;
+	PSHARDJOB pJobs = NULL;
+	struct stat st;
+
+	if(argc < 6 || (argc - 4) % 2 || (nRF = fillmode(argv[3])) < 0) { usage(); return -1; }
+	nShards = (argc - 4) / 2;
+	if(nShards > MAX_SHARDS)
+	{
+		fprintf(stderr, "ERROR: too many covers, max %d.\n", MAX_SHARDS);
+
+		return -1;
+	}
+	for(i = 2; i < argc; i++)
+	{
+		for(k = i + 1; k < argc; k++)
+		{
+			if(i != 3 && k != 3 && !strcmp(argv[i], argv[k]))
+			{
+				fprintf(stderr, "ERROR: overlapping file names.\n");
+
+				return -1;
+			}
+		}
+	}
+	if(statpath(argv[2], &st) || !S_ISREG(st.st_mode) || st.st_size < 1)
+	{
+		fprintf(stderr, "ERROR: could not get size of <data in>.\n");
+
+		return -1;
+	}
+	qwTotal = (uint64_t)st.st_size;
+	if((pJobs = (PSHARDJOB)calloc(nShards, sizeof(SHARDJOB))) == NULL || (pqwCap = (uint64_t *)calloc(nShards, sizeof(uint64_t))) == NULL)
+	{
+		fprintf(stderr, "ERROR: unable to allocate shard table.\n");
+		goto cleanup;
+	}
+	// capacity of each cover after the length pixels and shard header.
+	for(i = 0; i < nShards; i++)
+	{
+		pJobs[i].pDatain = argv[2];
+		pJobs[i].pBMPin = argv[4 + (i * 2)];
+		pJobs[i].pFileout = argv[5 + (i * 2)];
+		pJobs[i].nRF = nRF;
+		if((pJobs[i].fBMPin = openbmp(pJobs[i].pBMPin, pJobs[i].pBMPbufhdrin, &nFS1)) == NULL) goto cleanup;
+		pJobs[i].hc = validateheader(pJobs[i].pBMPbufhdrin, nFS1, 0, 1);
+		if(pJobs[i].hc.nValid != HDR_CHECKD_PASS)
+		{
+			fprintf(stderr, "ERROR: %s header check failed (%08X).\n", pJobs[i].pBMPin, pJobs[i].hc.dwFlags);
+			goto cleanup;
+		}
+		pqwCap[i] = (uint64_t)pJobs[i].hc.nBMPw * pJobs[i].hc.nBMPh;
+		k = FILE_SIZE_PIXELS + EXT_HDR_MIN + EXT_SHARD_LEN + EXT_CRC_LEN + (opts.bHaskey ? EXT_NONCE_LEN : 0);
+		pqwCap[i] = pqwCap[i] > k ? pqwCap[i] - k : 0;
+		if(pqwCap[i] > UINT32_MAX) pqwCap[i] = UINT32_MAX;
+		qwCap += pqwCap[i];
+	}
+	if(qwCap < qwTotal)
+	{
+		fprintf(stderr, "ERROR: <data in> is larger than the covers hold (%" PRIu64 " bytes).\n", qwCap);
+		goto cleanup;
+	}
+	// shards are sized in proportion to cover capacity so every cover
+	// carries a similar share, the remainder goes to covers with room.
+	qwLeft = qwTotal;
+	for(i = 0; i < nShards; i++)
+	{
+		pJobs[i].eh.dwLength = (uint32_t)(((unsigned __int128)qwTotal * pqwCap[i]) / qwCap);
+		qwLeft -= pJobs[i].eh.dwLength;
+	}
+	for(i = 0; i < nShards && qwLeft; i++)
+	{
+		k = pqwCap[i] - pJobs[i].eh.dwLength < qwLeft ? (int)(pqwCap[i] - pJobs[i].eh.dwLength) : (int)qwLeft;
+		pJobs[i].eh.dwLength += k;
+		qwLeft -= k;
+	}
+	dwSetid = ((uint32_t)rand() << 16) ^ (uint32_t)rand() ^ (uint32_t)time(NULL);
+	for(i = 0; i < nShards; i++)
+	{
+		pJobs[i].eh.wFlags = EXT_FLAG_SHARD | EXT_FLAG_CRC;
+		pJobs[i].eh.dwSetid = dwSetid;
+		pJobs[i].eh.wSeq = (uint16_t)i;
+		pJobs[i].eh.wShards = (uint16_t)nShards;
+		pJobs[i].eh.qwOffset = qwOffset;
+		pJobs[i].eh.qwTotal = qwTotal;
+		qwOffset += pJobs[i].eh.dwLength;
+		if(opts.bHaskey && newnonce(&pJobs[i].eh))
+		{
+			fprintf(stderr, "ERROR: unable to generate a nonce.\n");
+			goto cleanup;
+		}
+	}
+	nRan = 1;
+	if(runpool(nShards, jobmem(pJobs[0].eh.wFlags, 0), splitjob, pJobs))
+	{
+		for(i = 0; i < nShards; i++)
+		{
+			if(pJobs[i].nErr) fprintf(stderr, "ERROR: unable to encode %s, code %d.\n", pJobs[i].pFileout, pJobs[i].nErr);
+		}
+		goto cleanup;
+	}
+	ret = 0;
+
+cleanup:
+	for(i = 0; pJobs && i < nShards; i++)
+	{
+		if(pJobs[i].fBMPin) fclose(pJobs[i].fBMPin);
+		if(ret && nRan) removepath(pJobs[i].pFileout);
+	}
+	free(pJobs);
+	free(pqwCap);
+
+	return ret;
+}
+
+int cmdjoin(int argc, char **argv)
+{
+	// join <data out> <bmp in>...
+	int nFS1, nShards, i, k, e, ret = -1;
+	uint64_t qwOffset = 0;
+	char *pBMPbufin = NULL, *pFileout;
+	PSHARDJOB pJobs = NULL, *ppSeq = NULL;
+	FILE *fFileout = NULL;
+	PIXRDR pr;
+
+	if(argc < 4) { usage(); return -1; }
+	pFileout = argv[2];
+	nShards = argc - 3;
+	for(i = 3; i < argc; i++)
+	{
+		if(!strcmp(argv[i], pFileout))
+		{
+			fprintf(stderr, "ERROR: overlapping file names.\n");
+
+			return -1;
+		}
+	}
+	if((pJobs = (PSHARDJOB)calloc(nShards, sizeof(SHARDJOB))) == NULL || (ppSeq = (PSHARDJOB *)calloc(nShards, sizeof(PSHARDJOB))) == NULL || (pBMPbufin = (char *)malloc(BUF_SIZE)) == NULL)
+	{
+		fprintf(stderr, "ERROR: unable to allocate shard table.\n");
+		goto cleanup;
+	}
+	// read the shard headers, covers may be given in any order.
+	for(i = 0; i < nShards; i++)
+	{
+		pJobs[i].pBMPin = argv[3 + i];
+		pJobs[i].pFileout = pFileout;
+		if((pJobs[i].fBMPin = openbmp(pJobs[i].pBMPin, pJobs[i].pBMPbufhdrin, &nFS1)) == NULL) goto cleanup;
+		pJobs[i].hc = validateheader(pJobs[i].pBMPbufhdrin, nFS1, 0, 1);
+		if(pJobs[i].hc.nValid != HDR_CHECKD_PASS)
+		{
+			fprintf(stderr, "ERROR: %s header check failed (%08X).\n", pJobs[i].pBMPin, pJobs[i].hc.dwFlags);
+			goto cleanup;
+		}
+		pJobs[i].lData = ftello(pJobs[i].fBMPin);
+		pxinit(&pr, pJobs[i].fBMPin, pBMPbufin, pJobs[i].hc);
+		if((e = readpayloadhdr(&pr, &pJobs[i].eh)) == DEC_KEY)
+		{
+			fprintf(stderr, "ERROR: %s is encrypted, give --key-file or --key-env.\n", pJobs[i].pBMPin);
+			goto cleanup;
+		}
+		if(e != 0 || !(pJobs[i].eh.wFlags & EXT_FLAG_SHARD))
+		{
+			fprintf(stderr, "ERROR: %s does not hold a shard, code %d.\n", pJobs[i].pBMPin, e);
+			goto cleanup;
+		}
+		if(pJobs[i].eh.wShards != nShards || pJobs[i].eh.dwSetid != pJobs[0].eh.dwSetid || pJobs[i].eh.qwTotal != pJobs[0].eh.qwTotal)
+		{
+			fprintf(stderr, "ERROR: %s is not one of a set of %d shards.\n", pJobs[i].pBMPin, nShards);
+			goto cleanup;
+		}
+		k = pJobs[i].eh.wSeq;
+		if(ppSeq[k])
+		{
+			fprintf(stderr, "ERROR: %s and %s hold the same shard.\n", ppSeq[k]->pBMPin, pJobs[i].pBMPin);
+			goto cleanup;
+		}
+		ppSeq[k] = &pJobs[i];
+	}
+	// with no duplicates every sequence number is present, the shards must
+	// also tile the payload exactly.
+	for(k = 0; k < nShards; k++)
+	{
+		if(ppSeq[k]->eh.qwOffset != qwOffset) break;
+		qwOffset += ppSeq[k]->eh.dwLength;
+	}
+	if(k < nShards || qwOffset != pJobs[0].eh.qwTotal)
+	{
+		fprintf(stderr, "ERROR: shard offsets do not cover the payload.\n");
+		goto cleanup;
+	}
+	if((fFileout = fopenpath(pFileout, "wb")) == NULL || ftruncate(fileno(fFileout), (off_t)qwOffset))
+	{
+		fprintf(stderr, "ERROR: unable to open <data out>.\n");
+		goto cleanup;
+	}
+	fclose(fFileout);
+	fFileout = NULL;
+	if(runpool(nShards, jobmem(0xffff, 0), joinjob, pJobs))
+	{
+		for(i = 0; i < nShards; i++)
+		{
+			if(pJobs[i].nErr) fprintf(stderr, "ERROR: unable to decode %s, code %d.\n", pJobs[i].pBMPin, pJobs[i].nErr);
+		}
+		removepath(pFileout);
+		goto cleanup;
+	}
+	ret = 0;
+
+cleanup:
+	if(fFileout)
+	{
+		fclose(fFileout);
+		removepath(pFileout);
+	}
+	for(i = 0; pJobs && i < nShards; i++)
+	{
+		if(pJobs[i].fBMPin) fclose(pJobs[i].fBMPin);
+	}
+	free(pJobs);
+	free(ppSeq);
+	free(pBMPbufin);
+
+	return ret;
+}
+
+int probefile(char *pPath, uint32_t *pdwLength, uint32_t *pdwFlags)
+{
+	// triages one file from its headers and first scan line, enough
+	// pixels for the length and extended header of any cover at least 12
+	// pixels wide.  Returns a PROBE_ verdict.
+	uint8_t buf[sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + BUF_SIZE];
+	uint8_t b[FILE_SIZE_PIXELS + EXT_HDR_MIN];
+	uint64_t qwCap;
+	struct stat st;
+	ssize_t n;
+	int fd, i, nAvail;
+	HDRCHECK hc;
+
+	*pdwLength = 0;
+	*pdwFlags = 0;
+	if((fd = open(pPath, O_RDONLY)) < 0) return PROBE_INVALID;
+	if(fstat(fd, &st) || st.st_size > INT32_MAX || st.st_size < (sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + MIN_DATA))
+	{
+		close(fd);
+
+		return PROBE_INVALID;
+	}
+	n = pread(fd, buf, sizeof(buf), 0);
+	close(fd);
+	if(n < (ssize_t)(sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER))) return PROBE_INVALID;
+	hc = validateheader(buf, (int)st.st_size, 0, 1);
+	*pdwFlags = hc.dwFlags;
+	if(hc.nValid != HDR_CHECKD_PASS) return PROBE_INVALID;
+	// payload bytes held in the scan lines read.
+	n -= sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
+	for(nAvail = 0; nAvail < sizeof(b); nAvail++)
+	{
+		i = ((nAvail / hc.nBMPw) * hc.nStride) + ((nAvail % hc.nBMPw) * 3);
+		if(nAvail >= hc.nBMPw * hc.nBMPh || i + 3 > n) break;
+		extractrow(buf + sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + i, b + nAvail, 1);
+	}
+	if(nAvail < FILE_SIZE_PIXELS) return PROBE_INVALID;
+	qwCap = (uint64_t)hc.nBMPw * hc.nBMPh - FILE_SIZE_PIXELS;
+	*pdwLength = (uint32_t)getle(b, FILE_SIZE_PIXELS);
+	if(*pdwLength) return *pdwLength <= qwCap ? PROBE_POSSIBLE : PROBE_CLEAN;
+	// a zero length is only written ahead of an extended header.
+	if(nAvail < FILE_SIZE_PIXELS + 4 || b[2] != 'B' || b[3] != 'S' || b[4] != EXT_VERSION || b[5] < EXT_HDR_MIN || b[5] > qwCap) return PROBE_CLEAN;
+	if(nAvail == sizeof(b))
+	{
+		*pdwLength = (uint32_t)getle(b + 8, 4);
+		if(*pdwLength > qwCap - b[5]) return PROBE_CLEAN;
+	}
+
+	return PROBE_PAYLOAD;
+}
+
+void qinit(PPATHQUEUE q, int nCap)
+{
+	q->nCap = nCap;
+	q->nHead = 0;
+	q->nCount = 0;
+	q->bDone = 0;
+	pthread_mutex_init(&q->mtx, NULL);
+	pthread_cond_init(&q->cvPut, NULL);
+	pthread_cond_init(&q->cvGet, NULL);
+}
+
+void qput(PPATHQUEUE q, char *pPath)
+{
+	// hands a malloc'd path to the workers, blocks while the queue is full.
+	pthread_mutex_lock(&q->mtx);
+	while(q->nCount == q->nCap) pthread_cond_wait(&q->cvPut, &q->mtx);
+	q->ppPaths[(q->nHead + q->nCount) % q->nCap] = pPath;
+	q->nCount++;
+	pthread_cond_signal(&q->cvGet);
+	pthread_mutex_unlock(&q->mtx);
+}
+
+char *qget(PPATHQUEUE q)
+{
+	// returns the next path, NULL once the walk is done and the queue drained.
+	char *pPath = NULL;
+
+	pthread_mutex_lock(&q->mtx);
+	while(q->nCount == 0 && !q->bDone) pthread_cond_wait(&q->cvGet, &q->mtx);
+	if(q->nCount)
+	{
+		pPath = q->ppPaths[q->nHead];
+		q->nHead = (q->nHead + 1) % q->nCap;
+		q->nCount--;
+		pthread_cond_signal(&q->cvPut);
+	}
+	pthread_mutex_unlock(&q->mtx);
+
+	return pPath;
+}
+
+void qdone(PPATHQUEUE q)
+{
+	// no more paths, wakes every waiting worker.
+	pthread_mutex_lock(&q->mtx);
+	q->bDone = 1;
+	pthread_cond_broadcast(&q->cvGet);
+	pthread_mutex_unlock(&q->mtx);
+}
+
+int isbmpname(char *pName)
+{
+	// walked directories only yield files named *.bmp.
+	size_t n = strlen(pName);
+
+	return n > 4 && !strcasecmp(pName + n - 4, ".bmp");
+}
+
+int walkpath(PPATHQUEUE q, char *pPath, int bTop)
+{
+	// queues pPath, or every *.bmp below it when it is a directory.
+	// Returns the number of entries that could not be read.
+	struct dirent *de;
+	struct stat st;
+	DIR *d;
+	char *p;
+	size_t n;
+	int nErr = 0, bDir;
+
+	if(bTop)
+	{
+		if(stat(pPath, &st)) return 1;
+		if(!S_ISDIR(st.st_mode))
+		{
+			if((p = strdup(pPath)) == NULL) return 1;
+			qput(q, p);
+
+			return 0;
+		}
+	}
+	if((d = opendir(pPath)) == NULL) return 1;
+	n = strlen(pPath);
+	while((de = readdir(d)) != NULL)
+	{
+		if(!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) continue;
+		if((p = (char *)malloc(n + strlen(de->d_name) + 2)) == NULL) { nErr++; continue; }
+		sprintf(p, "%s%s%s", pPath, (n && pPath[n - 1] == '/') ? "" : "/", de->d_name);
+		// d_type saves a stat per entry on most filesystems.
+		bDir = de->d_type == DT_DIR;
+		if(de->d_type == DT_UNKNOWN) bDir = !stat(p, &st) && S_ISDIR(st.st_mode);
+		if(bDir)
+		{
+			nErr += walkpath(q, p, 0);
+			free(p);
+		}
+		else if((de->d_type == DT_REG || de->d_type == DT_UNKNOWN) && isbmpname(de->d_name))
+		{
+			qput(q, p);
+		}
+		else
+		{
+			free(p);
+		}
+	}
+	closedir(d);
+
+	return nErr;
+}
+
+void *probeworker(void *p)
+{
+	// probes queued paths and prints one line per file.
+	PPROBECTX pc = (PPROBECTX)p;
+	static const char *pVerdicts[] = { "invalid", "clean", "possible", "payload" };
+	uint32_t dwLength, dwFlags;
+	char *pPath;
+	int v;
+
+	pinworker();
+	while((pPath = qget(&pc->q)) != NULL)
+	{
+		v = probefile(pPath, &dwLength, &dwFlags);
+		__atomic_fetch_add(&pc->nCount[v], 1, __ATOMIC_RELAXED);
+		if(v == PROBE_INVALID) printf("%-8s  %08" PRIX32 "  %s\n", pVerdicts[v], dwFlags, pPath);
+		else printf("%-8s  %8" PRIu32 "  %s\n", pVerdicts[v], dwLength, pPath);
+		free(pPath);
+	}
+
+	return NULL;
+}
+
+int cmdprobe(int argc, char **argv)
+{
+	// probe [-j <threads>] <path>...
+	pthread_t *pThreads = NULL;
+	PROBECTX pc;
+	int nThreads, nStarted = 0, nErr = 0, i = 2;
+
+	nThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if(argc > 3 && !strcmp(argv[2], "-j"))
+	{
+		nThreads = atoi(argv[3]);
+		i = 4;
+	}
+	if(i >= argc || nThreads < 1) { usage(); return -1; }
+	nThreads = memthreads(nThreads, sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + BUF_SIZE);
+	memset(&pc, 0, sizeof(pc));
+	if((pc.q.ppPaths = (char **)malloc(PROBE_QUEUE * sizeof(char *))) == NULL || (pThreads = (pthread_t *)malloc(nThreads * sizeof(pthread_t))) == NULL)
+	{
+		fprintf(stderr, "ERROR: unable to allocate probe queue.\n");
+		free(pc.q.ppPaths);
+
+		return -1;
+	}
+	qinit(&pc.q, PROBE_QUEUE);
+	while(nStarted < nThreads && pthread_create(&pThreads[nStarted], workerattr(), probeworker, &pc) == 0) nStarted++;
+	if(nStarted == 0)
+	{
+		fprintf(stderr, "ERROR: unable to start probe workers.\n");
+		free(pc.q.ppPaths);
+		free(pThreads);
+
+		return -1;
+	}
+	for(; i < argc; i++) nErr += walkpath(&pc.q, argv[i], 1);
+	qdone(&pc.q);
+	for(i = 0; i < nStarted; i++) pthread_join(pThreads[i], NULL);
+	fflush(stdout);
+	fprintf(stderr, "probed %d files: %d payload, %d possible, %d clean, %d invalid, %d unreadable.\n", pc.nCount[PROBE_PAYLOAD] + pc.nCount[PROBE_POSSIBLE] + pc.nCount[PROBE_CLEAN] + pc.nCount[PROBE_INVALID], pc.nCount[PROBE_PAYLOAD], pc.nCount[PROBE_POSSIBLE], pc.nCount[PROBE_CLEAN], pc.nCount[PROBE_INVALID], nErr);
+	free(pc.q.ppPaths);
+	free(pThreads);
+
+	return 0;
+}
+
+uint32_t bodycrc(PDATASRC ds, int nHdr)
+{
+	// crc32c of the body once encode() has read it, the prefix bytes
+	// after the nHdr header bytes followed by each member.
+	uint32_t dwCRC;
+	int i;
+
+	dwCRC = crc32c(0, ds->pPrefix + nHdr, ds->nPrefix - nHdr);
+	for(i = 0; i < ds->nMembers; i++) dwCRC = crc32ccombine(dwCRC, ds->pMembers[i].dwCRC, ds->pMembers[i].dwLength);
+
+	return dwCRC;
+}
+
+int patchhdr(FILE *fFileout, HDRCHECK hc, PEXTHDR eh, PDATASRC ds, uint8_t *pRow)
+{
+	// stores the crc32c taken while encoding into the extended header of
+	// an already written <bmp out>.
+	uint8_t p[FILE_SIZE_PIXELS + sizeof(eh->bRaw)];
+
+	if(!(eh->wFlags & EXT_FLAG_CRC)) return 0;
+	eh->dwCRC = bodycrc(ds, FILE_SIZE_PIXELS + eh->nHdrlen);
+
+	return patchbytes(fFileout, hc, 0, p, putexthdr(eh, p), pRow) ? -20 : 0;
+}
+
+int verifyjob(void *pCtx, int i)
+{
+	// decodes one <bmp in> to nowhere and checks the body crc32c.
+	PVERIFYJOB j = &((PVERIFYJOB)pCtx)[i];
+	char pBMPbufhdrin[sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER)];
+	char *pBMPbufin = NULL;
+	FILE *fBMPin;
+	int nFS1;
+	PIXRDR pr;
+	EXTHDR eh;
+	HDRCHECK hc;
+
+	j->nResult = VERIFY_INVALID;
+	if((fBMPin = openbmp(j->pBMPin, pBMPbufhdrin, &nFS1)) == NULL) return -1;
+	hc = validateheader(pBMPbufhdrin, nFS1, 0, 1);
+	if(hc.nValid == HDR_CHECKD_PASS && (pBMPbufin = (char *)malloc(BUF_SIZE)) != NULL)
+	{
+		pxinit(&pr, fBMPin, pBMPbufin, hc);
+		if((i = readpayloadhdr(&pr, &eh)) == DEC_KEY)
+		{
+			j->dwLength = eh.dwLength;
+			j->nResult = VERIFY_NOKEY;
+		}
+		else if(i == 0)
+		{
+			j->dwLength = eh.dwLength;
+			if(!(eh.wFlags & EXT_FLAG_CRC)) j->nResult = VERIFY_NOCRC;
+			else if(eh.wFlags & EXT_FLAG_LZ) j->nResult = lzcopy(&pr, &eh, NULL, &j->dwCRC) == 0 && j->dwCRC == eh.dwCRC ? VERIFY_OK : VERIFY_CORRUPT;
+			else if(pxcopy(&pr, eh.dwData, NULL, &j->dwCRC) == 0) j->nResult = j->dwCRC == eh.dwCRC ? VERIFY_OK : VERIFY_CORRUPT;
+			else if(pr.pFec && pr.pFec->bFailed) j->nResult = VERIFY_CORRUPT;
+			pxclose(&pr);
+		}
+	}
+	fclose(fBMPin);
+	free(pBMPbufin);
+
+	return j->nResult != VERIFY_OK;
+}
+
+int cmdverify(int argc, char **argv)
+{
+	// verify <bmp in>...
+	static const char *pVerdicts[] = { "ok", "corrupt", "nocrc", "invalid", "nokey" };
+	PVERIFYJOB pJobs;
+	int nJobs, i, nFailed;
+
+	if(argc < 3) { usage(); return -1; }
+	nJobs = argc - 2;
+	if((pJobs = (PVERIFYJOB)calloc(nJobs, sizeof(VERIFYJOB))) == NULL)
+	{
+		fprintf(stderr, "ERROR: unable to allocate verify table.\n");
+
+		return -1;
+	}
+	for(i = 0; i < nJobs; i++) pJobs[i].pBMPin = argv[i + 2];
+	nFailed = runpool(nJobs, jobmem(0xffff, 0), verifyjob, pJobs);
+	for(i = 0; i < nJobs; i++) printf("%-8s  %10" PRIu32 "  %08" PRIX32 "  %s\n", pVerdicts[pJobs[i].nResult], pJobs[i].dwLength, pJobs[i].dwCRC, pJobs[i].pBMPin);
+	free(pJobs);
+
+	return nFailed ? -1 : 0;
+}
+
+void chachainit(PCIPHER ci, const uint8_t *pKey, const uint8_t *pNonce)
+{
+	// ChaCha20 state for a 256-bit key and 96-bit nonce, RFC 8439.  The
+	// block counter is filled in per block from the body offset.
+	int i;
+
+	ci->dwState[0] = 0x61707865; // "expand 32-byte k"
+	ci->dwState[1] = 0x3320646e;
+	ci->dwState[2] = 0x79622d32;
+	ci->dwState[3] = 0x6b206574;
+	for(i = 0; i < 8; i++) ci->dwState[4 + i] = (uint32_t)getle(pKey + (i * 4), 4);
+	ci->dwState[12] = 0;
+	for(i = 0; i < 3; i++) ci->dwState[13 + i] = (uint32_t)getle(pNonce + (i * 4), 4);
+}
+
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define QR(a, b, c, d) \
+	a += b; d ^= a; d = ROTL32(d, 16); \
+	c += d; b ^= c; b = ROTL32(b, 12); \
+	a += b; d ^= a; d = ROTL32(d, 8); \
+	c += d; b ^= c; b = ROTL32(b, 7);
+
+void chachablock(PCIPHER ci, uint32_t dwCounter, uint8_t *pOut)
+{
+	// one 64-byte keystream block.
+	uint32_t x[16];
+	int i;
+
+	memcpy(x, ci->dwState, sizeof(x));
+	x[12] = dwCounter;
+	for(i = 0; i < 10; i++)
+	{
+		QR(x[0], x[4], x[8], x[12]);
+		QR(x[1], x[5], x[9], x[13]);
+		QR(x[2], x[6], x[10], x[14]);
+		QR(x[3], x[7], x[11], x[15]);
+		QR(x[0], x[5], x[10], x[15]);
+		QR(x[1], x[6], x[11], x[12]);
+		QR(x[2], x[7], x[8], x[13]);
+		QR(x[3], x[4], x[9], x[14]);
+	}
+	for(i = 0; i < 16; i++) putle(pOut + (i * 4), x[i] + (i == 12 ? dwCounter : ci->dwState[i]), 4);
+}
+
+#if defined(__x86_64__)
+#define ROTL128(v, n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+#define QR128(a, b, c, d) \
+	a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = ROTL128(d, 16); \
+	c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = ROTL128(b, 12); \
+	a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = ROTL128(d, 8); \
+	c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = ROTL128(b, 7);
+
+void chachaxor4(PCIPHER ci, uint32_t dwCounter, uint8_t *p)
+{
+	// xors four consecutive keystream blocks into 256 bytes at p.  Each
+	// SSE2 lane runs one block, word i of all four blocks shares x[i].
+	__m128i x[16], s[16], t0, t1, t2, t3, *q;
+	int i;
+
+	for(i = 0; i < 16; i++) s[i] = _mm_set1_epi32((int)ci->dwState[i]);
+	s[12] = _mm_add_epi32(_mm_set1_epi32((int)dwCounter), _mm_set_epi32(3, 2, 1, 0));
+	memcpy(x, s, sizeof(x));
+	for(i = 0; i < 10; i++)
+	{
+		QR128(x[0], x[4], x[8], x[12]);
+		QR128(x[1], x[5], x[9], x[13]);
+		QR128(x[2], x[6], x[10], x[14]);
+		QR128(x[3], x[7], x[11], x[15]);
+		QR128(x[0], x[5], x[10], x[15]);
+		QR128(x[1], x[6], x[11], x[12]);
+		QR128(x[2], x[7], x[8], x[13]);
+		QR128(x[3], x[4], x[9], x[14]);
+	}
+	for(i = 0; i < 16; i++) x[i] = _mm_add_epi32(x[i], s[i]);
+	// transpose each group of four words back into block order.
+	q = (__m128i *)p;
+	for(i = 0; i < 16; i += 4)
+	{
+		t0 = _mm_unpacklo_epi32(x[i], x[i + 1]);
+		t1 = _mm_unpacklo_epi32(x[i + 2], x[i + 3]);
+		t2 = _mm_unpackhi_epi32(x[i], x[i + 1]);
+		t3 = _mm_unpackhi_epi32(x[i + 2], x[i + 3]);
+		_mm_storeu_si128(q + (i / 4), _mm_xor_si128(_mm_loadu_si128(q + (i / 4)), _mm_unpacklo_epi64(t0, t1)));
+		_mm_storeu_si128(q + 4 + (i / 4), _mm_xor_si128(_mm_loadu_si128(q + 4 + (i / 4)), _mm_unpackhi_epi64(t0, t1)));
+		_mm_storeu_si128(q + 8 + (i / 4), _mm_xor_si128(_mm_loadu_si128(q + 8 + (i / 4)), _mm_unpacklo_epi64(t2, t3)));
+		_mm_storeu_si128(q + 12 + (i / 4), _mm_xor_si128(_mm_loadu_si128(q + 12 + (i / 4)), _mm_unpackhi_epi64(t2, t3)));
+	}
+}
+#endif
+
+void chacha20xor(PCIPHER ci, uint64_t qwOffset, uint8_t *p, size_t n)
+{
+	// encrypts or decrypts n bytes at qwOffset in the body, so any part
+	// of the body can be processed on its own.
+	uint8_t ks[64];
+	uint32_t dwCounter = (uint32_t)(qwOffset / 64);
+	size_t i, k, nSkip = qwOffset % 64;
+
+	while(n)
+	{
+#if defined(__x86_64__)
+		if(nSkip == 0 && n >= 256)
+		{
+			chachaxor4(ci, dwCounter, p);
+			dwCounter += 4;
+			p += 256;
+			n -= 256;
+			continue;
+		}
+#endif
+		chachablock(ci, dwCounter++, ks);
+		k = 64 - nSkip;
+		if(k > n) k = n;
+		for(i = 0; i < k; i++) p[i] ^= ks[nSkip + i];
+		nSkip = 0;
+		p += k;
+		n -= k;
+	}
+}
+
+int loadkey(char *pKeyfile, char *pKeyenv)
+{
+	// reads the 256-bit key into opts, either 32 raw bytes from a file or
+	// 64 hex digits from a file or environment variable.
+	char buf[160], *p;
+	size_t n = 0;
+	FILE *f;
+	int i, k;
+
+	if(pKeyfile)
+	{
+		if((f = fopen(pKeyfile, "rb")) == NULL) return -1;
+		n = fread(buf, 1, sizeof(buf) - 1, f);
+		fclose(f);
+		if(n == sizeof(opts.bKey))
+		{
+			memcpy(opts.bKey, buf, n);
+			opts.bHaskey = 1;
+
+			return 0;
+		}
+	}
+	else
+	{
+		if((p = getenv(pKeyenv)) == NULL || (n = strlen(p)) > sizeof(buf) - 1) return -1;
+		memcpy(buf, p, n);
+	}
+	buf[n] = '\0';
+	for(p = buf, i = 0; *p && i < 2 * sizeof(opts.bKey); p++)
+	{
+		if(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') continue;
+		if(*p >= '0' && *p <= '9') k = *p - '0';
+		else if((*p | 0x20) >= 'a' && (*p | 0x20) <= 'f') k = (*p | 0x20) - 'a' + 10;
+		else return -2;
+		opts.bKey[i / 2] = (uint8_t)((opts.bKey[i / 2] << 4) | k);
+		i++;
+	}
+	while(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+	if(i != 2 * sizeof(opts.bKey) || *p) return -2;
+	opts.bHaskey = 1;
+
+	return 0;
+}
+
+int newnonce(PEXTHDR eh)
+{
+	// marks the body as encrypted under a fresh random nonce.
+	if(getrandom(eh->bNonce, sizeof(eh->bNonce), 0) != sizeof(eh->bNonce)) return -1;
+	eh->wFlags |= EXT_FLAG_CHACHA | EXT_FLAG_CRC;
+
+	return 0;
+}
+
+void srccipher(PDATASRC ds, PEXTHDR eh)
+{
+	// encrypts everything readsrc() emits after the payload header.
+	ds->nHdr = FILE_SIZE_PIXELS + eh->nHdrlen;
+	if((ds->bCipher = (eh->wFlags & EXT_FLAG_CHACHA) != 0)) chachainit(&ds->ci, opts.bKey, eh->bNonce);
+}
+
+int pxcipher(PPIXRDR pr, PEXTHDR eh)
+{
+	// decrypts everything pxread() extracts from the body.
+	pr->dwBody = FILE_SIZE_PIXELS + eh->nHdrlen;
+	pr->bCipher = 0;
+	if(!(eh->wFlags & EXT_FLAG_CHACHA)) return 0;
+	if(!opts.bHaskey) return DEC_KEY;
+	chachainit(&pr->ci, opts.bKey, eh->bNonce);
+	pr->bCipher = 1;
+
+	return 0;
+}
+
+int lzcompress(const uint8_t *pIn, int n, uint8_t *pOut, uint16_t *pHash)
+{
+	// LZ4-style sequences for one block: a token of literal and match
+	// length nibbles, 255-run length extensions, the literals and a
+	// 16-bit offset.  The last sequence holds literals only.  Returns the
+	// compressed size, at most LZ_BOUND(n).
+	const uint8_t *ip = pIn, *pEnd = pIn + n, *pAnchor = pIn, *pMatch;
+	uint8_t *op = pOut, *pToken;
+	uint64_t x, y;
+	uint32_t v, h;
+	int nLit, nLen;
+
+	memset(pHash, 0, LZ_HASH * sizeof(uint16_t));
+	while(ip + LZ_MIN_MATCH <= pEnd)
+	{
+		memcpy(&v, ip, 4);
+		h = (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+		pMatch = pIn + pHash[h];
+		pHash[h] = (uint16_t)(ip - pIn);
+		if(pMatch >= ip || memcmp(pMatch, ip, 4))
+		{
+			// step faster through data that does not compress.
+			ip += 1 + ((ip - pAnchor) >> 6);
+			continue;
+		}
+		// extend the match eight bytes at a time.
+		for(nLen = LZ_MIN_MATCH; ip + nLen + 8 <= pEnd; nLen += 8)
+		{
+			memcpy(&x, ip + nLen, 8);
+			memcpy(&y, pMatch + nLen, 8);
+			if((x ^= y) != 0) break;
+		}
+		if(ip + nLen + 8 <= pEnd) nLen += __builtin_ctzll(x) >> 3;
+		else while(ip + nLen < pEnd && ip[nLen] == pMatch[nLen]) nLen++;
+		nLit = (int)(ip - pAnchor);
+		pToken = op;
+		op = lzputlen(op + 1, nLit);
+		memcpy(op, pAnchor, nLit);
+		op += nLit;
+		putle(op, (uint64_t)(ip - pMatch), 2);
+		op = lzputlen(op + 2, nLen - LZ_MIN_MATCH);
+		*pToken = (uint8_t)(((nLit < 15 ? nLit : 15) << 4) | (nLen - LZ_MIN_MATCH < 15 ? nLen - LZ_MIN_MATCH : 15));
+		ip += nLen;
+		pAnchor = ip;
+	}
+	nLit = (int)(pEnd - pAnchor);
+	*op = (uint8_t)((nLit < 15 ? nLit : 15) << 4);
+	op = lzputlen(op + 1, nLit);
+	memcpy(op, pAnchor, nLit);
+
+	return (int)(op + nLit - pOut);
+}
+
+uint8_t *lzputlen(uint8_t *op, int n)
+{
+	// length extension bytes for a nibble of 15.
+	if(n < 15) return op;
+	for(n -= 15; n >= 255; n -= 255) *op++ = 255;
+	*op++ = (uint8_t)n;
+
+	return op;
+}
+
+int lzdecompress(const uint8_t *pIn, int n, uint8_t *pOut, int nMax)
+{
+	// reverses lzcompress(), checking every length and offset against
+	// both buffers.  Returns the decompressed size or -1.
+	const uint8_t *ip = pIn, *pEnd = pIn + n;
+	uint8_t *op = pOut, *pMatch;
+	int nLit, nLen, nOff, b;
+
+	while(ip < pEnd)
+	{
+		nLit = *ip >> 4;
+		nLen = (*ip++ & 15) + LZ_MIN_MATCH;
+		if(nLit == 15)
+		{
+			do
+			{
+				if(ip == pEnd) return -1;
+				nLit += (b = *ip++);
+			} while(b == 255);
+		}
+		if(nLit > pEnd - ip || nLit > nMax - (op - pOut)) return -1;
+		memcpy(op, ip, nLit);
+		op += nLit;
+		ip += nLit;
+		if(ip == pEnd) break;
+		if(pEnd - ip < 2) return -1;
+		nOff = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if(nLen == 15 + LZ_MIN_MATCH)
+		{
+			do
+			{
+				if(ip == pEnd) return -1;
+				nLen += (b = *ip++);
+			} while(b == 255);
+		}
+		if(nOff == 0 || nOff > op - pOut || nLen > nMax - (op - pOut)) return -1;
+		// matches may overlap their own output.
+		pMatch = op - nOff;
+		if(nOff >= nLen) memcpy(op, pMatch, nLen);
+		else for(b = 0; b < nLen; b++) op[b] = pMatch[b];
+		op += nLen;
+	}
+
+	return (int)(op - pOut);
+}
+
+int lzread(PDATASRC ds, uint8_t *p, int n)
+{
+	// compressed payload stream.  Members are read and compressed one
+	// LZ_BLOCK at a time as encode() drains the previous block, each
+	// block behind a 32-bit size with LZ_STORED set when it did not
+	// compress.
+	PLZSTREAM lz = ds->pLz;
+	int nRead = 0, k;
+
+	while(nRead < n)
+	{
+		if(lz->nPos == lz->nOut)
+		{
+			if((k = readmembers(ds, lz->bRaw, LZ_BLOCK)) <= 0) return k < 0 ? -1 : nRead;
+			lz->nOut = lzcompress(lz->bRaw, k, lz->bOut + 4, lz->wHash);
+			if(lz->nOut >= k)
+			{
+				memcpy(lz->bOut + 4, lz->bRaw, k);
+				lz->nOut = k;
+				putle(lz->bOut, LZ_STORED | (uint32_t)k, 4);
+			}
+			else
+			{
+				putle(lz->bOut, (uint32_t)lz->nOut, 4);
+			}
+			lz->nOut += 4;
+			lz->nPos = 0;
+		}
+		k = lz->nOut - lz->nPos;
+		if(k > n - nRead) k = n - nRead;
+		memcpy(p + nRead, lz->bOut + lz->nPos, k);
+		lz->nPos += k;
+		nRead += k;
+	}
+
+	return nRead;
+}
+
+int lzcopy(PPIXRDR pr, PEXTHDR eh, FILE *fFileout, uint32_t *pdwCRC)
+{
+	// decompresses the dwData byte body to fFileout block by block, as
+	// pxcopy() does for an uncompressed body.  The crc32c and dwRaw are
+	// of the decompressed data.
+	uint8_t *pIn, *pOut;
+	uint64_t qwRaw = 0;
+	uint32_t dwLeft = eh->dwData, dw;
+	int k, ret = -1;
+
+	*pdwCRC = 0;
+	pIn = (uint8_t *)malloc(LZ_BOUND(LZ_BLOCK));
+	pOut = (uint8_t *)malloc(LZ_BLOCK);
+	if(pIn == NULL || pOut == NULL) goto cleanup;
+	while(dwLeft)
+	{
+		ret = -2;
+		if(dwLeft < 4 || pxread(pr, pIn, 4)) goto cleanup;
+		dw = (uint32_t)getle(pIn, 4);
+		k = (int)(dw & ~LZ_STORED);
+		if(k > ((dw & LZ_STORED) ? LZ_BLOCK : LZ_BOUND(LZ_BLOCK)) || k > dwLeft - 4) goto cleanup;
+		ret = -3;
+		if(pxread(pr, pIn, k)) goto cleanup;
+		ret = -4;
+		if(dw & LZ_STORED) memcpy(pOut, pIn, k);
+		else if((k = lzdecompress(pIn, k, pOut, LZ_BLOCK)) < 0) goto cleanup;
+		ret = -5;
+		*pdwCRC = crc32c(*pdwCRC, pOut, k);
+		statlap(STAT_PAYLOAD, k);
+		if(fFileout && fwrite(pOut, 1, k, fFileout) != k) goto cleanup;
+		statlap(STAT_WRITE, k);
+		PROBE1(data_write, k);
+		dwLeft -= 4 + (dw & ~LZ_STORED);
+		qwRaw += k;
+	}
+	ret = qwRaw == eh->dwRaw ? 0 : -6;
+
+cleanup:
+	free(pIn);
+	free(pOut);
+
+	return ret;
+}
+
+uint8_t gfexp[511], gflog[256]; // GF(2^8) antilog and log tables, built by gfinit().
+void (*pfngfmac)(const uint8_t *pTbl, uint8_t *pDst, const uint8_t *pMul, const uint8_t *pAdd, int n); // selected by gfinit().
+pthread_once_t gfonce = PTHREAD_ONCE_INIT;
+
+void gfinit(void)
+{
+	// GF(2^8) log and antilog tables for the polynomial 0x11d, generator 2.
+	int i, x = 1;
+
+	for(i = 0; i < 255; i++)
+	{
+		gfexp[i] = (uint8_t)x;
+		gfexp[i + 255] = (uint8_t)x;
+		gflog[x] = (uint8_t)i;
+		x <<= 1;
+		if(x & 0x100) x ^= 0x11d;
+	}
+	gfexp[510] = gfexp[0];
+	pfngfmac = gfmacsw;
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("ssse3")) pfngfmac = gfmacssse3;
+#endif
+}
+
+uint8_t gfmul(uint8_t a, uint8_t b)
+{
+	return (a && b) ? gfexp[gflog[a] + gflog[b]] : 0;
+}
+
+uint8_t gfdiv(uint8_t a, uint8_t b)
+{
+	// b must not be zero.
+	return a ? gfexp[gflog[a] + 255 - gflog[b]] : 0;
+}
+
+void gftable(uint8_t *pTbl, uint8_t c)
+{
+	// products of c with every low nibble then every high nibble, so
+	// c * x is pTbl[x & 15] ^ pTbl[16 + (x >> 4)].
+	int i;
+
+	for(i = 0; i < 16; i++)
+	{
+		pTbl[i] = gfmul(c, (uint8_t)i);
+		pTbl[16 + i] = gfmul(c, (uint8_t)(i << 4));
+	}
+}
+
+void gfmacsw(const uint8_t *pTbl, uint8_t *pDst, const uint8_t *pMul, const uint8_t *pAdd, int n)
+{
+	// pDst = c * pMul ^ pAdd for the constant c of pTbl, pAdd may be NULL.
+	int i;
+
+	for(i = 0; i < n; i++) pDst[i] = pTbl[pMul[i] & 15] ^ pTbl[16 + (pMul[i] >> 4)] ^ (pAdd ? pAdd[i] : 0);
+}
+
+#if defined(__x86_64__)
+__attribute__((target("ssse3")))
+void gfmacssse3(const uint8_t *pTbl, uint8_t *pDst, const uint8_t *pMul, const uint8_t *pAdd, int n)
+{
+	// gfmacsw() sixteen bytes at a time, pshufb looks up both nibbles.
+	__m128i lo = _mm_loadu_si128((const __m128i *)pTbl), hi = _mm_loadu_si128((const __m128i *)(pTbl + 16));
+	__m128i mask = _mm_set1_epi8(0x0f), x, r;
+	int i;
+
+	for(i = 0; i + 16 <= n; i += 16)
+	{
+		x = _mm_loadu_si128((const __m128i *)(pMul + i));
+		r = _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(x, mask)), _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(x, 4), mask)));
+		if(pAdd) r = _mm_xor_si128(r, _mm_loadu_si128((const __m128i *)(pAdd + i)));
+		_mm_storeu_si128((__m128i *)(pDst + i), r);
+	}
+	gfmacsw(pTbl, pDst + i, pMul + i, pAdd ? pAdd + i : NULL, n - i);
+}
+#endif
+
+PFECCODER fecnew(int nParity, int nDepth)
+{
+	// coder for stripes of nDepth interleaved RS(255, 255 - nParity)
+	// codewords.  The generator has roots alpha^0 .. alpha^(nParity - 1).
+	PFECCODER f;
+	uint8_t gen[FEC_MAX_PARITY + 1];
+	int i, k;
+
+	pthread_once(&gfonce, gfinit);
+	if((f = (PFECCODER)calloc(1, sizeof(FECCODER))) == NULL) return NULL;
+	f->nParity = nParity;
+	f->nDepth = nDepth;
+	f->pData = (uint8_t *)malloc(FEC_N * nDepth);
+	f->pPar = (uint8_t *)malloc(nParity * nDepth);
+	f->pWork = (uint8_t *)malloc((nParity + 1) * nDepth);
+	if(f->pData == NULL || f->pPar == NULL || f->pWork == NULL)
+	{
+		fecfree(f);
+
+		return NULL;
+	}
+	memset(gen, 0, sizeof(gen));
+	gen[0] = 1;
+	for(i = 0; i < nParity; i++)
+	{
+		for(k = i + 1; k > 0; k--) gen[k] = gen[k - 1] ^ gfmul(gen[k], gfexp[i]);
+		gen[0] = gfmul(gen[0], gfexp[i]);
+	}
+	for(i = 0; i < nParity; i++)
+	{
+		gftable(f->bGen[i], gen[i]);
+		gftable(f->bSyn[i], gfexp[i]);
+	}
+
+	return f;
+}
+
+void fecfree(PFECCODER f)
+{
+	if(f == NULL) return;
+	free(f->pData);
+	free(f->pPar);
+	free(f->pWork);
+	free(f);
+}
+
+uint64_t fecsize(uint64_t qwData, int nParity, int nDepth)
+{
+	// embedded size of qwData body bytes, every stripe of up to
+	// (255 - nParity) * nDepth bytes is followed by nParity * nDepth.
+	uint64_t qwStripe = (uint64_t)(FEC_N - nParity) * nDepth;
+
+	if(nParity == 0 || qwData == 0) return qwData;
+
+	return qwData + ((qwData + qwStripe - 1) / qwStripe) * nParity * nDepth;
+}
+
+int fecdepth(uint64_t qwData, int nParity)
+{
+	// interleave just wide enough for qwData, so small payloads do not
+	// pay for a full stripe of parity.
+	uint64_t q = (qwData + FEC_N - nParity - 1) / (FEC_N - nParity);
+
+	return q < 1 ? 1 : q > FEC_DEPTH ? FEC_DEPTH : (int)q;
+}
+
+void fecencode(PFECCODER f, int nData)
+{
+	// appends the parity rows to the nData bytes in pData.  Byte j of the
+	// stripe is symbol j / nDepth of codeword j % nDepth, so all codewords
+	// step through the generator LFSR together, one row per step.  The
+	// parity rows are a ring, nHead is the highest degree row.
+	int nRows = (nData + f->nDepth - 1) / f->nDepth, nHead = 0, I = f->nDepth, P = f->nParity, t, k;
+	uint8_t *fb = f->pWork, *row;
+
+	memset(f->pData + nData, 0, nRows * I - nData);
+	memset(f->pPar, 0, P * I);
+	for(t = 0; t < nRows; t++)
+	{
+		row = f->pData + (t * I);
+		for(k = 0; k < I; k++) fb[k] = row[k] ^ f->pPar[(nHead * I) + k];
+		for(k = 0; k < P - 1; k++) pfngfmac(f->bGen[P - 1 - k], f->pPar + (((nHead + k + 1) % P) * I), fb, f->pPar + (((nHead + k + 1) % P) * I), I);
+		pfngfmac(f->bGen[0], f->pPar + (nHead * I), fb, NULL, I);
+		nHead = (nHead + 1) % P;
+	}
+	for(k = 0; k < P; k++) memcpy(f->pData + nData + (k * I), f->pPar + (((nHead + k) % P) * I), I);
+}
+
+int fecdecode(PFECCODER f, int nData)
+{
+	// corrects the stripe of nData bytes in pData with its parity rows in
+	// pPar.  Syndromes of all codewords are taken together a row at a
+	// time, only codewords with a nonzero syndrome are decoded alone.
+	// Returns the number of bytes corrected or -1.
+	int nRows = (nData + f->nDepth - 1) / f->nDepth, I = f->nDepth, P = f->nParity, nFixed = 0, t, j, c, k;
+	uint8_t syn[FEC_MAX_PARITY], *row;
+
+	memset(f->pData + nData, 0, nRows * I - nData);
+	memset(f->pWork, 0, P * I);
+	for(t = 0; t < nRows + P; t++)
+	{
+		row = t < nRows ? f->pData + (t * I) : f->pPar + ((t - nRows) * I);
+		for(j = 0; j < P; j++) pfngfmac(f->bSyn[j], f->pWork + (j * I), f->pWork + (j * I), row, I);
+	}
+	for(c = 0; c < I; c++)
+	{
+		for(j = 0, k = 0; j < P; j++) k |= (syn[j] = f->pWork[(j * I) + c]);
+		if(k == 0) continue;
+		if((k = fecfix(f, c, syn, nRows, nData)) < 0) return -1;
+		nFixed += k;
+	}
+
+	return nFixed;
+}
+
+int fecfix(PFECCODER f, int c, const uint8_t *syn, int nRows, int nData)
+{
+	// Berlekamp-Massey, Chien search and Forney on codeword c of the
+	// stripe.  Returns the number of symbols corrected or -1.
+	uint8_t lam[FEC_MAX_PARITY + 1], b[FEC_MAX_PARITY + 1], tmp[FEC_MAX_PARITY + 1], om[FEC_MAX_PARITY];
+	uint8_t d, bd = 1, x, num, den, *p;
+	int P = f->nParity, n = nRows + P, L = 0, m = 1, r, i, e, k, nFound = 0;
+
+	memset(lam, 0, sizeof(lam));
+	memset(b, 0, sizeof(b));
+	lam[0] = 1;
+	b[0] = 1;
+	for(r = 0; r < P; r++)
+	{
+		for(d = syn[r], i = 1; i <= L; i++) d ^= gfmul(lam[i], syn[r - i]);
+		if(d == 0)
+		{
+			m++;
+			continue;
+		}
+		memcpy(tmp, lam, sizeof(lam));
+		x = gfdiv(d, bd);
+		for(i = 0; i + m <= P; i++) lam[i + m] ^= gfmul(x, b[i]);
+		if(2 * L <= r)
+		{
+			L = r + 1 - L;
+			memcpy(b, tmp, sizeof(b));
+			bd = d;
+			m = 1;
+		}
+		else
+		{
+			m++;
+		}
+	}
+	if(2 * L > P) return -1;
+	// omega = syndromes * lambda mod x^P.
+	for(i = 0; i < P; i++)
+	{
+		for(om[i] = 0, k = 0; k <= i && k <= L; k++) om[i] ^= gfmul(lam[k], syn[i - k]);
+	}
+	// symbol k of the codeword has degree n - 1 - k, its locator is
+	// alpha^degree and lambda has a root at the inverse.
+	for(e = 0; e < n; e++)
+	{
+		x = gfexp[(255 - e) % 255];
+		for(d = 0, i = L; i >= 0; i--) d = gfmul(d, x) ^ lam[i];
+		if(d) continue;
+		for(num = 0, i = P - 1; i >= 0; i--) num = gfmul(num, x) ^ om[i];
+		for(den = 0, i = L - (L % 2 == 0); i >= 1; i -= 2) den = gfmul(den, gfmul(x, x)) ^ lam[i];
+		if(den == 0) return -1;
+		k = n - 1 - e;
+		if(k < nRows)
+		{
+			// padding past the end of the data is known to be zero.
+			if((k * f->nDepth) + c >= nData) return -1;
+			p = f->pData + (k * f->nDepth) + c;
+		}
+		else
+		{
+			p = f->pPar + ((k - nRows) * f->nDepth) + c;
+		}
+		*p ^= gfmul(gfexp[e], gfdiv(num, den));
+		nFound++;
+	}
+
+	return nFound == L ? nFound : -1;
+}
+
+int fecsrc(PDATASRC ds, uint8_t *p, int n)
+{
+	// body with the parity rows of each stripe after its data, stripes
+	// are full but for the last.
+	PFECCODER f = ds->pFec;
+	int nRead = 0, k;
+
+	while(nRead < n)
+	{
+		if(f->nPos == f->nOut)
+		{
+			if((k = readbody(ds, f->pData, (FEC_N - f->nParity) * f->nDepth)) <= 0) return k < 0 ? -1 : nRead;
+			fecencode(f, k);
+			f->nOut = k + (f->nParity * f->nDepth);
+			f->nPos = 0;
+		}
+		k = f->nOut - f->nPos;
+		if(k > n - nRead) k = n - nRead;
+		memcpy(p + nRead, f->pData + f->nPos, k);
+		f->nPos += k;
+		nRead += k;
+	}
+
+	return nRead;
+}
+
+int pxfec(PPIXRDR pr, uint8_t *p, int n)
+{
+	// extracts the next n body bytes a stripe at a time, corrected and
+	// then decrypted.
+	PFECCODER f;
+	int k, nData;
+
+	if(pr->pFec == NULL && (pr->pFec = fecnew(pr->nFecparity, pr->nFecdepth)) == NULL) return -3;
+	f = pr->pFec;
+	while(n > 0)
+	{
+		if(f->nPos == f->nOut)
+		{
+			k = pr->dwFecleft < FEC_N * f->nDepth ? (int)pr->dwFecleft : FEC_N * f->nDepth;
+			if((nData = k - (f->nParity * f->nDepth)) <= 0) return -1;
+			if(pxextract(pr, f->pData, nData) || pxextract(pr, f->pPar, f->nParity * f->nDepth)) return -2;
+			if((k = fecdecode(f, nData)) < 0)
+			{
+				f->bFailed = 1;
+
+				return -4;
+			}
+			f->nFixed += k;
+			if(pr->bCipher) chacha20xor(&pr->ci, f->qwBody, f->pData, nData);
+			f->qwBody += nData;
+			pr->dwFecleft -= nData + (f->nParity * f->nDepth);
+			f->nOut = nData;
+			f->nPos = 0;
+		}
+		k = f->nOut - f->nPos;
+		if(k > n) k = n;
+		memcpy(p, f->pData + f->nPos, k);
+		f->nPos += k;
+		p += k;
+		n -= k;
+	}
+
+	return 0;
+}
+
+uint32_t permute(const uint32_t *pKey, uint32_t x, uint32_t n, uint32_t dwTweak)
+{
+	// keyed bijection on [0, n), a balanced four round Feistel network on
+	// the smallest even bit width that holds n, cycle walking back into
+	// range.  Tiles are a power of 4 and never walk.
+	uint32_t l, r, v, t, mask;
+	int h = 1, i;
+
+	while(((uint64_t)1 << (2 * h)) < n) h++;
+	mask = ((uint32_t)1 << h) - 1;
+	do
+	{
+		l = x >> h;
+		r = x & mask;
+		for(i = 0; i < 4; i++)
+		{
+			v = (r ^ pKey[i] ^ dwTweak) * 0x9e3779b1;
+			v ^= v >> 16;
+			v *= 0x85ebca6b;
+			v ^= v >> 13;
+			t = r;
+			r = l ^ (v & mask);
+			l = t;
+		}
+		x = (l << h) | r;
+	} while(x >= n);
+
+	return x;
+}
+
+PPERMSTREAM permnew(PCIPHER ci, uint32_t dwPlan, uint64_t qwRegion)
+{
+	// round keys come from a keystream block far past any body offset, so
+	// every nonce gives a different placement.
+	PPERMSTREAM pp;
+	uint8_t blk[64];
+	int i;
+
+	if((pp = (PPERMSTREAM)bigalloc(sizeof(PERMSTREAM))) == NULL) return NULL;
+	chachablock(ci, PERM_COUNTER, blk);
+	for(i = 0; i < 4; i++) pp->dwKey[i] = (uint32_t)getle(blk + (i * 4), 4);
+	pp->qwRegion = qwRegion;
+	pp->qwPlan = dwPlan;
+	pp->qwNext = 0;
+	pp->qwOut = 0;
+	pp->dwBand = 0;
+	pp->nBand = 0;
+	pp->nSlots = 0;
+	pp->nPos = 0;
+
+	return pp;
+}
+
+void permband(PPERMSTREAM pp)
+{
+	// moves to the next band.  Band slots are planned in proportion to
+	// the band size, so the body is spread evenly over the image.
+	uint64_t qwEnd;
+
+	if(pp->nBand) pp->dwBand++;
+	pp->qwNext += pp->nBand;
+	qwEnd = pp->qwNext + PERM_BAND < pp->qwRegion ? pp->qwNext + PERM_BAND : pp->qwRegion;
+	pp->nBand = (int)(qwEnd - pp->qwNext);
+	pp->nSlots = (int)((pp->qwPlan * qwEnd) / pp->qwRegion - (pp->qwPlan * pp->qwNext) / pp->qwRegion);
+	pp->nPos = 0;
+	pp->nTile = -1;
+	pp->nTilefirst = 0;
+	pp->nTilenext = 0;
+}
+
+uint32_t permslot(PPERMSTREAM pp, int j)
+{
+	// band pixel of slot j, for j counting up from 0.  Each tile takes
+	// its share of the slots in a keyed order of its own, so consecutive
+	// slots stay in one cache-sized tile.  Tiles are visited in a keyed
+	// order, a short last tile stays last.
+	int nFull = pp->nBand / PERM_TILE, t;
+
+	if(j < pp->nTilefirst) pp->nTile = -1;
+	while(pp->nTile < 0 || j >= pp->nTilenext)
+	{
+		t = ++pp->nTile;
+		pp->nTilefirst = pp->nTile ? pp->nTilenext : 0;
+		pp->nTilenext = (int)(((uint64_t)pp->nSlots * ((t + 1) * PERM_TILE < pp->nBand ? (t + 1) * PERM_TILE : pp->nBand)) / pp->nBand);
+		pp->nTilebase = (t < nFull ? (int)permute(pp->dwKey, t, nFull, pp->dwBand) : t) * PERM_TILE;
+		pp->nTilesize = t < nFull ? PERM_TILE : pp->nBand - (nFull * PERM_TILE);
+	}
+
+	return pp->nTilebase + permute(pp->dwKey, j - pp->nTilefirst, pp->nTilesize, (pp->dwBand * 0x9e3779b1) ^ ~(uint32_t)pp->nTile);
+}
+
+int readcoded(PDATASRC ds, uint8_t *p, int n)
+{
+	// body bytes as embedded, after any fec stage.
+	int k;
+
+	if((k = ds->pFec ? fecsrc(ds, p, n) : readbody(ds, p, n)) > 0) ds->qwCoded += k;
+
+	return k;
+}
+
+int permsrc(PDATASRC ds, uint8_t *p, uint8_t *pMask, int n)
+{
+	// body slots in pixel order to the end of the image, a band at a
+	// time.  pMask flags the slots holding a body byte.
+	PPERMSTREAM pp = ds->pPerm;
+	int nRead = 0, k, j, i;
+
+	while(nRead < n)
+	{
+		if(pp->nPos == pp->nBand)
+		{
+			if(pp->qwNext + pp->nBand == pp->qwRegion)
+			{
+				// the body must have fit in the planned slots.
+				if(nRead == 0 && readcoded(ds, pp->bIn, 1) != 0) return -1;
+				break;
+			}
+			permband(pp);
+			if((k = readcoded(ds, pp->bIn, pp->nSlots)) < 0) return -1;
+			memset(pp->bUsed, 0, pp->nBand);
+			for(j = 0; j < k; j++)
+			{
+				i = permslot(pp, j);
+				pp->bSlot[i] = pp->bIn[j];
+				pp->bUsed[i] = 1;
+			}
+		}
+		k = pp->nBand - pp->nPos;
+		if(k > n - nRead) k = n - nRead;
+		memcpy(p + nRead, pp->bSlot + pp->nPos, k);
+		memcpy(pMask + nRead, pp->bUsed + pp->nPos, k);
+		pp->nPos += k;
+		nRead += k;
+	}
+
+	return nRead;
+}
+
+void embedmasked(uint8_t *pC, const uint8_t *pData, const uint8_t *pMask, int n, int nRF)
+{
+	// embedrow() for the flagged bytes and fillrow() for the others.
+	int i, k;
+
+	for(i = 0; i < n; i += k)
+	{
+		for(k = 1; i + k < n && pMask[i + k] == pMask[i]; k++);
+		if(pMask[i]) embedrow(pC + (i * 3), pData + i, k);
+		else fillrow(pC + (i * 3), k, nRF);
+	}
+}
+
+int pxperm(PPIXRDR pr, uint8_t *p, int n)
+{
+	// gathers the next n body bytes from their slots, extracting a band
+	// of pixels at a time.
+	PPERMSTREAM pp;
+	int k;
+
+	if(pr->pPerm == NULL && (pr->pPerm = permnew(&pr->ci, pr->dwPlan, (uint64_t)pr->hc.nBMPw * pr->hc.nBMPh - pr->dwBody)) == NULL) return -3;
+	pp = pr->pPerm;
+	for(k = 0; k < n; k++)
+	{
+		while(pp->nPos == pp->nSlots)
+		{
+			if(pp->nBand && pp->qwNext + pp->nBand == pp->qwRegion) return -1;
+			permband(pp);
+			if(pp->nSlots && (pxseek(pr, pr->dwBody + (uint32_t)pp->qwNext) || pxraw(pr, pp->bSlot, pp->nBand))) return -2;
+		}
+		p[k] = pp->bSlot[permslot(pp, pp->nPos++)];
+	}
+	if(pr->bCipher && !pr->nFecparity) chacha20xor(&pr->ci, pp->qwOut, p, n);
+	pp->qwOut += n;
+
+	return 0;
+}
+
+const uint8_t adaptmask[4] = { 0x00, 0x29, 0x6b, 0xff }; // bits of the 3-2-3 byte each class may change.
+const int adaptbits[4] = { 0, 3, 5, 8 };
+uint8_t adaptdep[4][256], adaptext[4][256]; // class bits to and from the 3-2-3 byte, built by adaptinit().
+pthread_once_t adaptonce = PTHREAD_ONCE_INIT;
+
+void adaptinit(void)
+{
+	// deposit and extract tables between class bits and the 3-2-3 byte.
+	int c, v, i, k;
+
+	for(c = 0; c < 4; c++)
+	{
+		for(v = 0; v < 256; v++)
+		{
+			adaptdep[c][v] = 0;
+			adaptext[c][v] = 0;
+			for(i = 0, k = 0; i < 8; i++)
+			{
+				if(!(adaptmask[c] & (1 << i))) continue;
+				if(v & (1 << k)) adaptdep[c][v] |= (uint8_t)(1 << i);
+				if(v & (1 << i)) adaptext[c][v] |= (uint8_t)(1 << k);
+				k++;
+			}
+		}
+	}
+}
+
+PADAPTMAP adaptnew(int nW)
+{
+	// a map for scan lines nW pixels wide.
+	PADAPTMAP am;
+	uint8_t *p;
+	int i;
+
+	pthread_once(&adaptonce, adaptinit);
+	if((am = (PADAPTMAP)malloc(sizeof(ADAPTMAP) + 6 * (size_t)(nW + 2))) == NULL) return NULL;
+	p = (uint8_t *)(am + 1);
+	for(i = 0; i < 3; i++) am->pG[i] = p + (i * (nW + 2));
+	am->pMax = p + (3 * (nW + 2));
+	am->pMin = p + (4 * (nW + 2));
+	am->pClass = p + (5 * (nW + 2));
+	am->nW = nW;
+	am->nRows = 0;
+	am->nRow = -1;
+	am->dwAcc = 0;
+	am->nAcc = 0;
+	am->qwOut = 0;
+
+	return am;
+}
+
+void adaptnext(PADAPTMAP am, const uint8_t *pC)
+{
+	// slides the window onto the scan line at pC and classifies it.  The
+	// texture value leaves out the bits any class may change.
+	uint8_t *g = am->pG[0];
+	int i;
+
+	am->pG[0] = am->pG[1];
+	am->pG[1] = am->pG[2];
+	am->pG[2] = g;
+	for(i = 0; i < am->nW; i++, pC += 3) g[i] = (uint8_t)((pC[0] >> 3) + (pC[1] >> 3) + (pC[2] >> 3));
+	if(am->nRows++ == 0)
+	{
+		memcpy(am->pG[0], g, am->nW);
+		memcpy(am->pG[1], g, am->nW);
+	}
+	adaptclass(am);
+}
+
+void adaptclass(PADAPTMAP am)
+{
+	// class of each pixel of the newest row from the range of texture
+	// values in its 3x3 window, the number of ADAPT_ thresholds it is
+	// over.  Rows before the first repeat it, columns past either edge
+	// repeat the edge pixel.
+	const uint8_t *a = am->pG[0], *b = am->pG[1], *c = am->pG[2];
+	uint8_t *mx = am->pMax + 1, *mn = am->pMin + 1, hi, lo, r;
+	int i = 0, w = am->nW;
+#if defined(__x86_64__)
+	__m128i va, vb, vc, vr, vk, z = _mm_setzero_si128();
+
+	for(; i + 16 <= w; i += 16)
+	{
+		va = _mm_loadu_si128((const __m128i *)(a + i));
+		vb = _mm_loadu_si128((const __m128i *)(b + i));
+		vc = _mm_loadu_si128((const __m128i *)(c + i));
+		_mm_storeu_si128((__m128i *)(mx + i), _mm_max_epu8(_mm_max_epu8(va, vb), vc));
+		_mm_storeu_si128((__m128i *)(mn + i), _mm_min_epu8(_mm_min_epu8(va, vb), vc));
+	}
+#endif
+	for(; i < w; i++)
+	{
+		hi = a[i] > b[i] ? a[i] : b[i];
+		mx[i] = hi > c[i] ? hi : c[i];
+		lo = a[i] < b[i] ? a[i] : b[i];
+		mn[i] = lo < c[i] ? lo : c[i];
+	}
+	mx[-1] = mx[0];
+	mx[w] = mx[w - 1];
+	mn[-1] = mn[0];
+	mn[w] = mn[w - 1];
+	i = 0;
+#if defined(__x86_64__)
+	for(; i + 16 <= w; i += 16)
+	{
+		va = _mm_max_epu8(_mm_max_epu8(_mm_loadu_si128((const __m128i *)(mx + i - 1)), _mm_loadu_si128((const __m128i *)(mx + i))), _mm_loadu_si128((const __m128i *)(mx + i + 1)));
+		vb = _mm_min_epu8(_mm_min_epu8(_mm_loadu_si128((const __m128i *)(mn + i - 1)), _mm_loadu_si128((const __m128i *)(mn + i))), _mm_loadu_si128((const __m128i *)(mn + i + 1)));
+		vr = _mm_sub_epi8(va, vb);
+		// 3, less one for every threshold the range is not over.
+		vk = _mm_set1_epi8(3);
+		vk = _mm_add_epi8(vk, _mm_cmpeq_epi8(_mm_subs_epu8(vr, _mm_set1_epi8(ADAPT_FLAT)), z));
+		vk = _mm_add_epi8(vk, _mm_cmpeq_epi8(_mm_subs_epu8(vr, _mm_set1_epi8(ADAPT_LOW)), z));
+		vk = _mm_add_epi8(vk, _mm_cmpeq_epi8(_mm_subs_epu8(vr, _mm_set1_epi8(ADAPT_MID)), z));
+		_mm_storeu_si128((__m128i *)(am->pClass + i), vk);
+	}
+#endif
+	for(; i < w; i++)
+	{
+		hi = mx[i - 1] > mx[i] ? mx[i - 1] : mx[i];
+		if(mx[i + 1] > hi) hi = mx[i + 1];
+		lo = mn[i - 1] < mn[i] ? mn[i - 1] : mn[i];
+		if(mn[i + 1] < lo) lo = mn[i + 1];
+		r = hi - lo;
+		am->pClass[i] = (uint8_t)((r > ADAPT_FLAT) + (r > ADAPT_LOW) + (r > ADAPT_MID));
+	}
+}
+
+int adaptrow(PDATASRC ds, uint8_t *pC, uint8_t *pData, int nW, uint32_t dwPixel, int bDone, int nRF)
+{
+	// embeds a scan line of the payload stream, each body pixel taking
+	// the bits of its class.  Pixels of the payload header take a whole
+	// byte as in embedrow().  Returns 1 once the stream has ended and -1
+	// on error.
+	PADAPTMAP am = ds->pAdapt;
+	int i, c, nHdr = 0, nBits = 0, nNeed, nRead = 0, nUsed;
+	uint8_t dibyte, v;
+
+	adaptnext(am, pC);
+	if(dwPixel < (uint32_t)ds->nHdr) nHdr = ds->nHdr - dwPixel < (uint32_t)nW ? (int)(ds->nHdr - dwPixel) : nW;
+	if(!bDone)
+	{
+		for(i = nHdr; i < nW; i++) nBits += adaptbits[am->pClass[i]];
+		nNeed = nHdr + (nBits > am->nAcc ? (nBits - am->nAcc + 7) / 8 : 0);
+		statlap(STAT_TRANSFORM, 0);
+		if((nRead = readsrc(ds, pData, nNeed)) < 0) return -1;
+		statlap(STAT_PAYLOAD, nRead);
+		bDone = nRead < nNeed;
+	}
+	if(nRead < nHdr)
+	{
+		embedrow(pC, pData, nRead);
+		fillrow(pC + (nRead * 3), nHdr - nRead, nRF);
+		nRead = nHdr;
+	}
+	else
+	{
+		embedrow(pC, pData, nHdr);
+	}
+	for(i = nHdr, nUsed = nHdr; i < nW; i++)
+	{
+		if((c = am->pClass[i]) == 0) continue;
+		while(am->nAcc < adaptbits[c] && nUsed < nRead)
+		{
+			am->dwAcc |= (uint32_t)pData[nUsed++] << am->nAcc;
+			am->nAcc += 8;
+		}
+		if(am->nAcc)
+		{
+			// the last bits of the stream are padded with zeros.
+			v = adaptdep[c][am->dwAcc & ((1 << adaptbits[c]) - 1)];
+			am->dwAcc = am->nAcc > adaptbits[c] ? am->dwAcc >> adaptbits[c] : 0;
+			am->nAcc = am->nAcc > adaptbits[c] ? am->nAcc - adaptbits[c] : 0;
+		}
+		else if(nRF)
+		{
+			v = fillbyte(nRF) & adaptmask[c];
+		}
+		else
+		{
+			continue;
+		}
+		extractrow(pC + (i * 3), &dibyte, 1);
+		dibyte = (dibyte & ~adaptmask[c]) | v;
+		embedrow(pC + (i * 3), &dibyte, 1);
+	}
+
+	return bDone;
+}
+
+int pxadaptrow(PPIXRDR pr)
+{
+	// classifies scan line nRow, replaying the two before it when the
+	// map is not on the previous line.
+	PADAPTMAP am = pr->pAdapt;
+	int nRow;
+
+	if(am->nRow != pr->nRow - 1)
+	{
+		am->nRows = 0;
+		for(nRow = pr->nRow > 2 ? pr->nRow - 2 : 0; nRow < pr->nRow; nRow++)
+		{
+			if(pxload(pr, nRow)) return -1;
+			adaptnext(am, pr->pRow);
+		}
+		if(pxload(pr, pr->nRow)) return -1;
+	}
+	adaptnext(am, pr->pRow);
+	am->nRow = pr->nRow;
+
+	return 0;
+}
+
+int pxadapt(PPIXRDR pr, uint8_t *p, int n)
+{
+	// extracts the next n body bytes from the class bits of each pixel,
+	// decrypted unless there is parity to check first.
+	PADAPTMAP am;
+	uint8_t dibyte;
+	int i, c;
+
+	if(pr->pAdapt == NULL && (pr->pAdapt = adaptnew(pr->hc.nBMPw)) == NULL) return -3;
+	am = pr->pAdapt;
+	for(i = 0; i < n; i++)
+	{
+		while(am->nAcc < 8)
+		{
+			if(pr->nCol == pr->hc.nBMPw)
+			{
+				pr->nRow++;
+				pr->nCol = 0;
+			}
+			if(pr->nRow >= pr->hc.nBMPh) return -1;
+			if(pxload(pr, pr->nRow) || (am->nRow != pr->nRow && pxadaptrow(pr))) return -2;
+			c = am->pClass[pr->nCol];
+			extractrow(pr->pRow + (pr->nCol++ * 3), &dibyte, 1);
+			am->dwAcc |= (uint32_t)adaptext[c][dibyte] << am->nAcc;
+			am->nAcc += adaptbits[c];
+		}
+		p[i] = (uint8_t)am->dwAcc;
+		am->dwAcc >>= 8;
+		am->nAcc -= 8;
+	}
+	statlap(STAT_TRANSFORM, 0);
+	if(pr->bCipher && !pr->nFecparity) chacha20xor(&pr->ci, am->qwOut, p, n);
+	am->qwOut += n;
+
+	return 0;
+}
+
+void lsbrow(PLSBSTATS ls, const uint8_t *pC, int nW)
+{
+	// adds one scan line to the statistics of each channel: the value
+	// histogram, horizontal sample pairs and RS groups of four pixels.
+	int c, i, k, u, v, g[4], f0, f1, fm;
+	PLSBSTATS s;
+
+	for(c = 0; c < 3; c++)
+	{
+		s = ls + c;
+		// two histograms halve the stalls on runs of equal values.
+		for(i = 0; i + 1 < nW; i += 2)
+		{
+			s->qwHist[0][pC[(i * 3) + c]]++;
+			s->qwHist[1][pC[(i * 3) + 3 + c]]++;
+		}
+		if(i < nW) s->qwHist[0][pC[(i * 3) + c]]++;
+		// branch free, the classes of noisy pixels do not predict.
+		for(i = 1; i < nW; i++)
+		{
+			u = pC[((i - 1) * 3) + c];
+			v = pC[(i * 3) + c];
+			k = u == v;
+			s->qwZ += k;
+			s->qwX += !k & (((v & 1) == 0) == (u < v));
+			s->qwW += !k & (((v & 1) == 0) != (u < v)) & ((u >> 1) == (v >> 1));
+		}
+		s->qwPairs += nW > 1 ? nW - 1 : 0;
+		for(i = 0; i + 4 <= nW; i += 4)
+		{
+			for(k = 0; k < 4; k++) g[k] = pC[((i + k) * 3) + c];
+			// as embedded, then with every LSB flipped.
+			for(k = 0; k < 2; k++)
+			{
+				f0 = lsbsmooth(g[0], g[1], g[2], g[3]);
+				f1 = lsbsmooth(g[0], g[1] ^ 1, g[2] ^ 1, g[3]);
+				fm = lsbsmooth(g[0], ((g[1] + 1) ^ 1) - 1, ((g[2] + 1) ^ 1) - 1, g[3]);
+				s->qwR[k * 2] += f1 > f0;
+				s->qwS[k * 2] += f1 < f0;
+				s->qwR[(k * 2) + 1] += fm > f0;
+				s->qwS[(k * 2) + 1] += fm < f0;
+				g[0] ^= 1;
+				g[1] ^= 1;
+				g[2] ^= 1;
+				g[3] ^= 1;
+			}
+		}
+	}
+}
+
+int lsbsmooth(int a, int b, int c, int d)
+{
+	// RS discrimination function, the variation along a group.
+	return abs(b - a) + abs(c - b) + abs(d - c);
+}
+
+double lsbroot(double a, double b, double c)
+{
+	// root of a*x*x + b*x + c nearest to zero.  Without a real root the
+	// vertex is taken, fully embedded planes come out close to that.
+	double d = (b * b) - (4 * a * c), r1, r2;
+
+	if(a == 0) return b != 0 ? -c / b : 0;
+	if(d < 0) return -b / (2 * a);
+	r1 = (-b + sqrt(d)) / (2 * a);
+	r2 = (-b - sqrt(d)) / (2 * a);
+
+	return fabs(r1) < fabs(r2) ? r1 : r2;
+}
+
+double lsbchi(PLSBSTATS s)
+{
+	// chi-square attack, the probability that the pairs of values 2k
+	// and 2k+1 were evened out by embedding.
+	double x = 0, e, d;
+	int k, n = 0;
+
+	for(k = 0; k < 256; k += 2)
+	{
+		e = (double)(s->qwHist[0][k] + s->qwHist[1][k] + s->qwHist[0][k + 1] + s->qwHist[1][k + 1]) / 2;
+		if(e < ANALYZE_CHI_MIN) continue;
+		d = (double)(s->qwHist[0][k] + s->qwHist[1][k]) - e;
+		x += (d * d) / e;
+		n++;
+	}
+	if(n < 2) return 0;
+
+	return gammaq((n - 1) / 2.0, x / 2);
+}
+
+double lsbrs(PLSBSTATS s)
+{
+	// RS analysis estimate of the fraction of pixels embedded.
+	double g = (double)s->qwGroups, d0, d1, dm0, dm1, z;
+
+	if(g == 0) return 0;
+	d0 = (s->qwR[0] - (double)s->qwS[0]) / g;
+	dm0 = (s->qwR[1] - (double)s->qwS[1]) / g;
+	d1 = (s->qwR[2] - (double)s->qwS[2]) / g;
+	dm1 = (s->qwR[3] - (double)s->qwS[3]) / g;
+	z = lsbroot(2 * (d1 + d0), dm0 - dm1 - d1 - (3 * d0), d0 - dm0);
+
+	return z == 0.5 ? 1 : z / (z - 0.5);
+}
+
+double lsbspa(PLSBSTATS s)
+{
+	// sample pair analysis estimate of the fraction of pixels embedded.
+	double x = (double)s->qwX, y = (double)(s->qwPairs - s->qwX - s->qwZ);
+
+	if(s->qwPairs == 0) return 0;
+
+	return lsbroot((s->qwW + (double)s->qwZ) / 2, (2 * x) - s->qwPairs, y - x);
+}
+
+double gammaq(double a, double x)
+{
+	// upper regularized incomplete gamma function Q(a, x), a series
+	// below a + 1 and a continued fraction above.  lgamma_r() leaves
+	// signgam alone, analyze workers run this at once.
+	double s, t, b, c, d, h, an, lg;
+	int i, sg;
+
+	if(x <= 0) return 1;
+	lg = lgamma_r(a, &sg);
+	if(x < a + 1)
+	{
+		for(s = t = 1 / a, i = 1; i < 1000 && fabs(t) > fabs(s) * 1e-15; i++)
+		{
+			t *= x / (a + i);
+			s += t;
+		}
+
+		return 1 - (s * exp((a * log(x)) - x - lg));
+	}
+	b = x + 1 - a;
+	c = 1 / 1e-300;
+	d = 1 / b;
+	h = d;
+	for(i = 1; i < 1000; i++)
+	{
+		an = -i * (i - a);
+		b += 2;
+		d = (an * d) + b;
+		if(fabs(d) < 1e-300) d = 1e-300;
+		c = b + (an / c);
+		if(fabs(c) < 1e-300) c = 1e-300;
+		d = 1 / d;
+		t = d * c;
+		h *= t;
+		if(fabs(t - 1) < 1e-15) break;
+	}
+
+	return exp((a * log(x)) - x - lg) * h;
+}
+
+int analyzefile(char *pPath, double *pScore, double *pChi, double *pRS, double *pSPA, uint32_t *pdwFlags)
+{
+	// streams the scan lines of pPath once and fills the per channel
+	// estimates, BGR order.  Returns an ANALYZE_ verdict.
+	char hdr[sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER)];
+	LSBSTATS ls[3];
+	uint8_t *pRow = NULL;
+	struct stat st;
+	FILE *f;
+	int c, nRow, v = ANALYZE_INVALID;
+	double e;
+	HDRCHECK hc;
+
+	*pScore = 0;
+	*pdwFlags = 0;
+	if((f = fopenpath(pPath, "rb")) == NULL) return ANALYZE_INVALID;
+	if(fstat(fileno(f), &st) || st.st_size > INT32_MAX || st.st_size < (off_t)sizeof(hdr) || fseeko(f, 0, SEEK_SET) || fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr)) goto cleanup;
+	hc = validateheader(hdr, (int)st.st_size, 0, 1);
+	*pdwFlags = hc.dwFlags;
+	if(hc.nValid != HDR_CHECKD_PASS || (pRow = (uint8_t *)malloc(hc.nStride)) == NULL) goto cleanup;
+	memset(ls, 0, sizeof(ls));
+	for(nRow = 0; nRow < hc.nBMPh; nRow++)
+	{
+		if(fread(pRow, 1, hc.nStride, f) != hc.nStride) goto cleanup;
+		lsbrow(ls, pRow, hc.nBMPw);
+	}
+	for(c = 0; c < 3; c++)
+	{
+		ls[c].qwGroups = (uint64_t)(hc.nBMPw / 4) * hc.nBMPh;
+		pChi[c] = lsbchi(ls + c);
+		pRS[c] = lsbrs(ls + c);
+		pSPA[c] = lsbspa(ls + c);
+		// the two length estimates agree on covers, a channel scores
+		// their mean clipped to [0, 1].
+		e = (pRS[c] + pSPA[c]) / 2;
+		if(e < 0) e = 0;
+		if(e > 1) e = 1;
+		if(e > *pScore) *pScore = e;
+	}
+	v = *pScore >= ANALYZE_SUSPECT_AT ? ANALYZE_SUSPECT : ANALYZE_CLEAN;
+
+cleanup:
+	fclose(f);
+	free(pRow);
+
+	return v;
+}
+
+void *analyzeworker(void *p)
+{
+	// analyzes queued paths and prints one line per file.
+	PANALYZECTX ac = (PANALYZECTX)p;
+	static const char *pVerdicts[] = { "invalid", "clean", "suspect" };
+	double dScore, dChi[3], dRS[3], dSPA[3];
+	uint32_t dwFlags;
+	char *pPath;
+	int v;
+
+	pinworker();
+	while((pPath = qget(&ac->q)) != NULL)
+	{
+		v = analyzefile(pPath, &dScore, dChi, dRS, dSPA, &dwFlags);
+		__atomic_fetch_add(&ac->nCount[v], 1, __ATOMIC_RELAXED);
+		if(v == ANALYZE_INVALID) printf("%-8s  %08" PRIX32 "  %s\n", pVerdicts[v], dwFlags, pPath);
+		else printf("%-8s  %.3f  chi %.2f %.2f %.2f  rs %.3f %.3f %.3f  spa %.3f %.3f %.3f  %s\n", pVerdicts[v], dScore, dChi[0], dChi[1], dChi[2], dRS[0], dRS[1], dRS[2], dSPA[0], dSPA[1], dSPA[2], pPath);
+		free(pPath);
+	}
+
+	return NULL;
+}
+
+int cmdanalyze(int argc, char **argv)
+{
+	// analyze [-j <threads>] <path>...
+	pthread_t *pThreads = NULL;
+	ANALYZECTX ac;
+	int nThreads, nStarted = 0, nErr = 0, i = 2;
+
+	nThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if(argc > 3 && !strcmp(argv[2], "-j"))
+	{
+		nThreads = atoi(argv[3]);
+		i = 4;
+	}
+	if(i >= argc || nThreads < 1) { usage(); return -1; }
+	nThreads = memthreads(nThreads, BUF_SIZE + BUFSIZ);
+	memset(&ac, 0, sizeof(ac));
+	if((ac.q.ppPaths = (char **)malloc(PROBE_QUEUE * sizeof(char *))) == NULL || (pThreads = (pthread_t *)malloc(nThreads * sizeof(pthread_t))) == NULL)
+	{
+		fprintf(stderr, "ERROR: unable to allocate analyze queue.\n");
+		free(ac.q.ppPaths);
+
+		return -1;
+	}
+	qinit(&ac.q, PROBE_QUEUE);
+	while(nStarted < nThreads && pthread_create(&pThreads[nStarted], workerattr(), analyzeworker, &ac) == 0) nStarted++;
+	if(nStarted == 0)
+	{
+		fprintf(stderr, "ERROR: unable to start analyze workers.\n");
+		free(ac.q.ppPaths);
+		free(pThreads);
+
+		return -1;
+	}
+	for(; i < argc; i++) nErr += walkpath(&ac.q, argv[i], 1);
+	qdone(&ac.q);
+	for(i = 0; i < nStarted; i++) pthread_join(pThreads[i], NULL);
+	fprintf(stderr, "analyzed %d files: %d suspect, %d clean, %d invalid, %d unreadable.\n", ac.nCount[ANALYZE_SUSPECT] + ac.nCount[ANALYZE_CLEAN] + ac.nCount[ANALYZE_INVALID], ac.nCount[ANALYZE_SUSPECT], ac.nCount[ANALYZE_CLEAN], ac.nCount[ANALYZE_INVALID], nErr);
+	free(ac.q.ppPaths);
+	free(pThreads);
+
+	return ac.nCount[ANALYZE_SUSPECT] ? 1 : 0;
+}
+
+const BENCHCOVER benchcovers[] =
+{
+	{ "tiny", 8, 4, 0 }, // room for the extended header and 16 bytes.
+	{ "narrow", 1, 65536, 0 }, // 1 pixel wide, every scan line padded.
+	{ "padded", 1001, 701, 0 }, // odd width, 1 byte of padding per scan line.
+	{ "wide", 2720, 1536, 0 }, // widest scan line the buffers hold.
+	{ "large", 2720, 250000, 1 }, // about 2 GB, the largest size an int holds.
+	// shapes the tree cannot take yet, scan lines past BUF_SIZE and files
+	// past INT32_MAX, are reported as unsupported so the gap shows.
+	{ "4k", 3840, 2160, 0 },
+	{ "16k", 16384, 1024, 0 },
+	{ "huge", 2720, 400000, 0 } // over 3 GB.
+};
+const double benchratios[] = { 0.01, 0.5, 0.95 }; // payload share of the capacity.
+
+uint64_t benchrand(uint64_t *pState)
+{
+	// xorshift64*, the same covers and payloads on every run.
+	*pState ^= *pState >> 12;
+	*pState ^= *pState << 25;
+	*pState ^= *pState >> 27;
+
+	return *pState * 0x2545f4914f6cdd1dULL;
+}
+
+void bmpheader(uint8_t *p, int nW, int nH)
+{
+	// BMP headers of an nW by nH cover.
+	PBITMAPFILEHEADER bfh = (PBITMAPFILEHEADER)p;
+	PBITMAPINFOHEADER bih = (PBITMAPINFOHEADER)(p + sizeof(BITMAPFILEHEADER));
+	int nStride = ((nW * 3) + 3) & ~3;
+
+	memset(p, 0, sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER));
+	bfh->bfType[0] = 'B';
+	bfh->bfType[1] = 'M';
+	bfh->bfOffBits = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
+	bfh->bfSize = (uint32_t)(bfh->bfOffBits + ((uint64_t)nStride * nH));
+	bih->biSize = sizeof(BITMAPINFOHEADER);
+	bih->biWidth = nW;
+	bih->biHeight = nH;
+	bih->biPlanes = 1;
+	bih->biBitCount = 24;
+	bih->biCompression = BI_RGB;
+}
+
+void genrow(PGENCOVER gc, int nRow, uint8_t *pRow)
+{
+	// scan line nRow of smooth gradients with a little noise, so fill
+	// modes and adaptive depth see something like a photograph.  Scan
+	// lines are made in order, padding is zeroed.
+	uint64_t r;
+	int x;
+
+	for(x = 0; x < gc->nW; x++)
+	{
+		r = benchrand(&gc->qwState);
+		pRow[x * 3] = (uint8_t)(((x * 160) / gc->nW) + 48 + (r & 7));
+		pRow[(x * 3) + 1] = (uint8_t)(((nRow * 160) / gc->nH) + 48 + ((r >> 8) & 7));
+		pRow[(x * 3) + 2] = (uint8_t)((((x + nRow) * 80) / (gc->nW + gc->nH)) + 96 + ((r >> 16) & 7));
+	}
+	memset(pRow + (gc->nW * 3), 0, gc->nStride - (gc->nW * 3));
+}
+
+int benchcover(char *pPath, int nW, int nH)
+{
+	// writes a genrow() cover, the same one on every run.
+	uint8_t hdr[sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER)];
+	GENCOVER gc = { 0x9e3779b97f4a7c15ULL ^ ((uint64_t)nW << 32) ^ (uint64_t)nH, nW, nH, ((nW * 3) + 3) & ~3 };
+	uint8_t *pRow;
+	FILE *f = NULL;
+	int y, e = -1;
+
+	if((pRow = (uint8_t *)malloc(gc.nStride)) == NULL) return -1;
+	if((f = fopen(pPath, "wb")) == NULL) goto cleanup;
+	bmpheader(hdr, nW, nH);
+	if(fwrite(hdr, 1, sizeof(hdr), f) != sizeof(hdr)) goto cleanup;
+	for(y = 0; y < nH; y++)
+	{
+		genrow(&gc, y, pRow);
+		if(fwrite(pRow, 1, gc.nStride, f) != gc.nStride) goto cleanup;
+	}
+	e = 0;
+
+cleanup:
+	if(f && fclose(f)) e = -1;
+	free(pRow);
+
+	return e;
+}
+
+int benchpayload(char *pPath, uint64_t qwLength)
+{
+	// writes qwLength incompressible bytes.
+	uint64_t qwState = 0x2545f4914f6cdd1dULL ^ qwLength, buf[BUF_SIZE / 8];
+	FILE *f;
+	size_t k;
+	int i, e = 0;
+
+	if((f = fopen(pPath, "wb")) == NULL) return -1;
+	while(qwLength && e == 0)
+	{
+		for(i = 0; i < BUF_SIZE / 8; i++) buf[i] = benchrand(&qwState);
+		k = qwLength < BUF_SIZE ? (size_t)qwLength : BUF_SIZE;
+		if(fwrite(buf, 1, k, f) != k) e = -1;
+		qwLength -= k;
+	}
+	if(fclose(f)) e = -1;
+
+	return e;
+}
+
+int benchrun(char **ppArgs, int nArgs, PBENCHRESULT br)
+{
+	// runs main() on ppArgs in a child, so peak RSS and the read and
+	// write calls from /proc/self/io cover that run alone.
+	struct timespec t0, t1;
+	struct rusage ru;
+	uint64_t qwIO[2] = { 0, 0 };
+	pid_t pid;
+	int fds[2], nStatus, fd, bHuge;
+	ssize_t n;
+
+	memset(br, 0, sizeof(BENCHRESULT));
+	if(pipe(fds)) return -1;
+	fflush(stdout);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if((pid = fork()) < 0)
+	{
+		close(fds[0]);
+		close(fds[1]);
+
+		return -1;
+	}
+	if(pid == 0)
+	{
+		close(fds[0]);
+		if((fd = open("/dev/null", O_WRONLY)) >= 0)
+		{
+			dup2(fd, 1);
+			dup2(fd, 2);
+			close(fd);
+		}
+		// the memory layout options carry over to every run, --pin through
+		// the cpu list.
+		bHuge = opts.bHuge;
+		memset(&opts, 0, sizeof(opts));
+		opts.bHuge = bHuge;
+		nStatus = main(nArgs, ppArgs);
+		procio(qwIO);
+		if(write(fds[1], qwIO, sizeof(qwIO)) != sizeof(qwIO)) nStatus = -1;
+		_exit(nStatus & 0xff);
+	}
+	close(fds[1]);
+	n = read(fds[0], qwIO, sizeof(qwIO));
+	close(fds[0]);
+	if(wait4(pid, &nStatus, 0, &ru) != pid) return -1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	br->dWall = (t1.tv_sec - t0.tv_sec) + ((t1.tv_nsec - t0.tv_nsec) / 1e9);
+	br->dUser = ru.ru_utime.tv_sec + (ru.ru_utime.tv_usec / 1e6);
+	br->dSys = ru.ru_stime.tv_sec + (ru.ru_stime.tv_usec / 1e6);
+	br->lMaxrss = ru.ru_maxrss;
+	if(n == sizeof(qwIO))
+	{
+		br->qwReads = qwIO[0];
+		br->qwWrites = qwIO[1];
+	}
+	br->nExit = WIFEXITED(nStatus) ? WEXITSTATUS(nStatus) : 128 + WTERMSIG(nStatus);
+
+	return 0;
+}
+
+void benchprint(const BENCHCOVER *bc, double dRatio, uint64_t qwPayload, char *pOp, char cFill, char *pStatus, PBENCHRESULT br, uint64_t qwImage)
+{
+	// one JSON object per line, fields in a fixed order for diffing.
+	printf("{\"cover\":\"%s\",\"width\":%d,\"height\":%d,\"ratio\":%.2f,\"payload\":%" PRIu64 ",\"op\":\"%s\",\"fill\":\"%c\",\"status\":\"%s\"", bc->pName, bc->nW, bc->nH, dRatio, qwPayload, pOp, cFill, pStatus);
+	if(br)
+	{
+		printf(",\"exit\":%d,\"seconds\":%.6f,\"user\":%.6f,\"sys\":%.6f", br->nExit, br->dWall, br->dUser, br->dSys);
+		printf(",\"mb_s\":%.2f,\"pixels_s\":%.0f", br->dWall > 0 ? qwImage / br->dWall / 1e6 : 0, br->dWall > 0 ? (double)bc->nW * bc->nH / br->dWall : 0);
+		printf(",\"maxrss_kb\":%ld,\"read_calls\":%" PRIu64 ",\"write_calls\":%" PRIu64, br->lMaxrss, br->qwReads, br->qwWrites);
+		printf(",\"hugepages\":%d,\"pinned\":%d", opts.bHuge, nPincpus ? 1 : 0);
+	}
+	printf("}\n");
+}
+
+int benchbest(char **ppArgs, int nArgs, int nRepeat, PBENCHRESULT br)
+{
+	// the fastest of nRepeat runs, or the first that fails.
+	BENCHRESULT t;
+	int i;
+
+	for(i = 0; i < nRepeat; i++)
+	{
+		if(benchrun(ppArgs, nArgs, &t)) return -1;
+		if(i == 0 || t.nExit || t.dWall < br->dWall) *br = t;
+		if(t.nExit) break;
+	}
+
+	return 0;
+}
+
+int cmdbench(int argc, char **argv)
+{
+	// bench [-d <dir>] [-r <repeat>] [-s quick | full]
+	static const char cFills[] = { 'n', 'r', 'd', 'l' };
+	char pDir[PATH_MAX], pCover[PATH_MAX + 16], pData[PATH_MAX + 16], pOut[PATH_MAX + 16], pBack[PATH_MAX + 16];
+	char pFill[2] = { 0, 0 }, *pTmp = NULL, *pArgs[8];
+	uint8_t hdr[sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER)];
+	const BENCHCOVER *bc;
+	BENCHRESULT br;
+	uint64_t qwCap, qwPayload, qwImage;
+	int i, j, k, nRepeat = 1, bFull = 0, bOwn = 0, e = 0;
+	HDRCHECK hc;
+
+	for(i = 2; i < argc; i += 2)
+	{
+		if(i + 1 >= argc) { usage(); return -1; }
+		if(!strcmp(argv[i], "-d")) pTmp = argv[i + 1];
+		else if(!strcmp(argv[i], "-r")) nRepeat = atoi(argv[i + 1]);
+		else if(!strcmp(argv[i], "-s") && (!strcmp(argv[i + 1], "quick") || !strcmp(argv[i + 1], "full"))) bFull = argv[i + 1][0] == 'f';
+		else { usage(); return -1; }
+	}
+	if(nRepeat < 1) { usage(); return -1; }
+	if(pTmp == NULL)
+	{
+		snprintf(pDir, sizeof(pDir), "%s/bmpsteg-bench-XXXXXX", getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+		if(mkdtemp(pDir) == NULL)
+		{
+			fprintf(stderr, "ERROR: unable to create a bench directory.\n");
+
+			return -1;
+		}
+		bOwn = 1;
+	}
+	else
+	{
+		snprintf(pDir, sizeof(pDir), "%s", pTmp);
+	}
+	snprintf(pCover, sizeof(pCover), "%s/cover.bmp", pDir);
+	snprintf(pData, sizeof(pData), "%s/data.bin", pDir);
+	snprintf(pOut, sizeof(pOut), "%s/out.bmp", pDir);
+	snprintf(pBack, sizeof(pBack), "%s/back.bin", pDir);
+	pArgs[0] = argv[0];
+	pArgs[1] = "--crc";
+	for(i = 0; i < sizeof(benchcovers) / sizeof(benchcovers[0]) && e == 0; i++)
+	{
+		bc = &benchcovers[i];
+		if(bc->bFull && !bFull) continue;
+		// shapes the header check refuses are reported once, not timed.
+		qwImage = (uint64_t)(((bc->nW * 3) + 3) & ~3) * bc->nH;
+		qwCap = (uint64_t)bc->nW * bc->nH;
+		qwCap = qwCap > FILE_SIZE_PIXELS + EXT_HDR_MIN + EXT_CRC_LEN ? qwCap - FILE_SIZE_PIXELS - EXT_HDR_MIN - EXT_CRC_LEN : 0;
+		bmpheader(hdr, bc->nW, bc->nH);
+		hc.nValid = 0;
+		if(qwCap && qwImage + sizeof(hdr) <= INT32_MAX) hc = validateheader(hdr, (int)(qwImage + sizeof(hdr)), 0, 1);
+		if(hc.nValid != HDR_CHECKD_PASS)
+		{
+			benchprint(bc, 0, 0, "e", '-', "unsupported", NULL, qwImage);
+			continue;
+		}
+		if(benchcover(pCover, bc->nW, bc->nH))
+		{
+			fprintf(stderr, "ERROR: unable to write the %s cover in %s.\n", bc->pName, pDir);
+			e = -1;
+			break;
+		}
+		for(j = 0; j < sizeof(benchratios) / sizeof(benchratios[0]) && e == 0; j++)
+		{
+			qwPayload = (uint64_t)(qwCap * benchratios[j]);
+			if(qwPayload < 1) qwPayload = 1;
+			if(benchpayload(pData, qwPayload))
+			{
+				fprintf(stderr, "ERROR: unable to write the payload in %s.\n", pDir);
+				e = -1;
+				break;
+			}
+			for(k = 0; k < sizeof(cFills); k++)
+			{
+				pFill[0] = cFills[k];
+				pArgs[2] = "e";
+				pArgs[3] = pCover;
+				pArgs[4] = pData;
+				pArgs[5] = pOut;
+				pArgs[6] = pFill;
+				pArgs[7] = NULL;
+				if(benchbest(pArgs, 7, nRepeat, &br)) { e = -1; break; }
+				benchprint(bc, benchratios[j], qwPayload, "e", cFills[k], br.nExit ? "failed" : "ok", &br, qwImage);
+				if(br.nExit) continue;
+				pArgs[2] = "d";
+				pArgs[3] = pOut;
+				pArgs[4] = pBack;
+				pArgs[5] = NULL;
+				if(benchbest(pArgs, 5, nRepeat, &br)) { e = -1; break; }
+				benchprint(bc, benchratios[j], qwPayload, "d", cFills[k], br.nExit ? "failed" : "ok", &br, qwImage);
+			}
+		}
+	}
+	if(e) fprintf(stderr, "ERROR: bench stopped, code %d.\n", e);
+	remove(pCover);
+	remove(pData);
+	remove(pOut);
+	remove(pBack);
+	if(bOwn) rmdir(pDir);
+
+	return e;
+}
+
+int kerneltest(int nRounds)
+{
+	// differential test of every usable kernel against embedrowsw() and
+	// extractrowsw() on random scan lines.  Widths 1, 2 and those around
+	// the SIMD block come up often, as do odd widths and their padding.
+	// Returns the number of mismatches.
+	static const int nWidths[] = { 1, 2, 3, 5, 15, 16, 17, 31, 32, 33, 47, 48, 49, 1001 };
+	uint8_t *pRef = NULL, *pTry = NULL, *pData = NULL, *pOut = NULL, *pBack = NULL;
+	int r, k, w, nAlign, nOff, n, i, nSpan, nBad = 0, nTotal = 4 * BUF_SIZE;
+
+	pthread_once(&rowonce, rowinit);
+	srand(1);
+	if((pRef = (uint8_t *)malloc(nTotal)) == NULL || (pTry = (uint8_t *)malloc(nTotal)) == NULL || (pData = (uint8_t *)malloc(nTotal)) == NULL || (pOut = (uint8_t *)malloc(nTotal)) == NULL || (pBack = (uint8_t *)malloc(nTotal)) == NULL)
+	{
+		nBad = -1;
+		goto cleanup;
+	}
+	for(r = 0; r < nRounds; r++)
+	{
+		w = rand() % 2 ? nWidths[rand() % (sizeof(nWidths) / sizeof(nWidths[0]))] : 1 + (rand() % ((BUF_SIZE / 3) - 1));
+		nAlign = rand() % 64;
+		// a part of the scan line as at the payload header and end.
+		n = rand() % 4 ? w : rand() % (w + 1);
+		nOff = rand() % (w - n + 1);
+		// the scan line with guard bytes either side.
+		nSpan = nAlign + (((w * 3) + 3) & ~3) + 64;
+		for(i = 0; i < nSpan; i++)
+		{
+			pRef[i] = (uint8_t)rand();
+			pData[i] = (uint8_t)rand();
+		}
+		memcpy(pTry, pRef, nSpan);
+		embedrowsw(pRef + nAlign + (nOff * 3), pData + nAlign, n);
+		extractrowsw(pRef + nAlign + (nOff * 3), pBack, n);
+		if(memcmp(pBack, pData + nAlign, n)) nBad++;
+		for(k = 1; k < sizeof(rowkernels) / sizeof(rowkernels[0]); k++)
+		{
+			if(!rowkernels[k].pfnUsable()) continue;
+			// padding and the guard bytes must come out untouched.
+			memcpy(pOut, pTry, nSpan);
+			rowkernels[k].pfnEmbed(pOut + nAlign + (nOff * 3), pData + nAlign, n);
+			if(memcmp(pOut, pRef, nSpan))
+			{
+				fprintf(stderr, "kernel %s embed differs, width %d, %d pixels at %d, align %d.\n", rowkernels[k].pName, w, n, nOff, nAlign);
+				nBad++;
+			}
+			memset(pOut, 0xa5, n + 16);
+			rowkernels[k].pfnExtract(pRef + nAlign + (nOff * 3), pOut + (nAlign & 15), n);
+			if(memcmp(pOut + (nAlign & 15), pBack, n) || pOut[(nAlign & 15) + n] != 0xa5)
+			{
+				fprintf(stderr, "kernel %s extract differs, width %d, %d pixels at %d, align %d.\n", rowkernels[k].pName, w, n, nOff, nAlign);
+				nBad++;
+			}
+		}
+	}
+
+cleanup:
+	free(pRef);
+	free(pTry);
+	free(pData);
+	free(pOut);
+	free(pBack);
+
+	return nBad;
+}
+
+double kerneltime(int k, int bExtract, uint8_t *pCover, uint8_t *pData, int w, int nRows)
+{
+	// seconds for one pass of kernel k over nRows scan lines.
+	struct timespec t0, t1;
+	int j;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if(bExtract) for(j = 0; j < nRows; j++) rowkernels[k].pfnExtract(pCover, pData + (j & 1), w);
+	else for(j = 0; j < nRows; j++) rowkernels[k].pfnEmbed(pCover, pData, w);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	return (t1.tv_sec - t0.tv_sec) + ((t1.tv_nsec - t0.tv_nsec) / 1e9);
+}
+
+void kernelbench(int nPixels)
+{
+	// times each usable kernel on scan lines of several widths and
+	// alignments, one JSON object per line.  A case runs at least nPixels
+	// pixels and KERNEL_BENCH_MIN per pass, so narrow and wide scan lines
+	// are timed over a span the clock resolves, after an untimed pass to
+	// warm the caches, and the fastest of KERNEL_BENCH_RUNS passes counts.
+	static const int nWidths[] = { 1, 2, 15, 16, 1001, 2720 };
+	static const char *pOps[] = { "embed", "extract" };
+	static uint8_t bCover[BUF_SIZE + 64], bData[BUF_SIZE + 64];
+	double dSec, dBest;
+	int k, iw, a, op, r, j, w, nRows;
+
+	pthread_once(&rowonce, rowinit);
+	for(j = 0; j < sizeof(bCover); j++) bCover[j] = bData[j] = (uint8_t)rand();
+	for(k = 0; k < sizeof(rowkernels) / sizeof(rowkernels[0]); k++)
+	{
+		if(!rowkernels[k].pfnUsable()) continue;
+		for(iw = 0; iw < sizeof(nWidths) / sizeof(nWidths[0]); iw++)
+		{
+			w = nWidths[iw];
+			for(a = 0; a < 2; a++)
+			{
+				for(op = 0; op < 2; op++)
+				{
+					nRows = nPixels / w > 0 ? nPixels / w : 1;
+					kerneltime(k, op, bCover + a, bData + a, w, nRows);
+					while((dSec = kerneltime(k, op, bCover + a, bData + a, w, nRows)) < KERNEL_BENCH_MIN && nRows < INT32_MAX / 2) nRows *= 2;
+					dBest = dSec;
+					for(r = 1; r < KERNEL_BENCH_RUNS; r++)
+					{
+						if((dSec = kerneltime(k, op, bCover + a, bData + a, w, nRows)) < dBest) dBest = dSec;
+					}
+					printf("{\"kernel\":\"%s\",\"op\":\"%s\",\"width\":%d,\"align\":%d,\"rows\":%d,\"ns_row\":%.1f,\"mb_s\":%.1f}\n", rowkernels[k].pName, pOps[op], w, a, nRows, dBest * 1e9 / nRows, dBest > 0 ? 3.0 * w * nRows / dBest / 1e6 : 0);
+				}
+			}
+		}
+	}
+}
+
+int cmdkernels(int argc, char **argv)
+{
+	// kernels test [-n <scan lines>] | bench [-n <pixels>]
+	int n = 0, nBad;
+
+	if(argc != 3 && argc != 5) { usage(); return -1; }
+	if(argc == 5)
+	{
+		if(strcmp(argv[3], "-n") || (n = atoi(argv[4])) < 1) { usage(); return -1; }
+	}
+	if(!strcmp(argv[2], "test"))
+	{
+		if((nBad = kerneltest(n ? n : KERNEL_TEST_ROUNDS)) < 0)
+		{
+			fprintf(stderr, "ERROR: unable to allocate test buffers.\n");
+
+			return -1;
+		}
+		fprintf(stderr, "kernels: %d mismatches in %d scan lines, %s selected.\n", nBad, n ? n : KERNEL_TEST_ROUNDS, pfnembed == embedrowsw ? "scalar" : "simd");
+
+		return nBad ? 1 : 0;
+	}
+	if(!strcmp(argv[2], "bench"))
+	{
+		kernelbench(n ? n : KERNEL_BENCH_PIXELS);
+
+		return 0;
+	}
+	usage();
+
+	return -1;
+}
+
+int procio(uint64_t *pqwIO)
+{
+	// read and write system calls made so far, from /proc/self/io.
+	char buf[512], *p;
+	ssize_t n;
+	int fd;
+
+	pqwIO[0] = pqwIO[1] = 0;
+	if((fd = open("/proc/self/io", O_RDONLY)) < 0) return -1;
+	n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if(n <= 0) return -1;
+	buf[n] = '\0';
+	if((p = strstr(buf, "syscr:")) != NULL) pqwIO[0] = strtoull(p + 6, NULL, 10);
+	if((p = strstr(buf, "syscw:")) != NULL) pqwIO[1] = strtoull(p + 6, NULL, 10);
+
+	return 0;
+}
+
+uint64_t statclock(void)
+{
+	// ticks cheap enough to read around every scan line, the timestamp
+	// counter where there is one.
+#if defined(__x86_64__)
+	return __builtin_ia32_rdtsc();
+#else
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return ((uint64_t)t.tv_sec * 1000000000) + t.tv_nsec;
+#endif
+}
+
+void statstart(void)
+{
+	// starts the --stats clocks, the first lap runs from here.
+	memset(&stats, 0, sizeof(stats));
+	clock_gettime(CLOCK_MONOTONIC, &stats.tStart);
+	stats.qwStart = stats.qwLast = statclock();
+	statcpu(-1, stats.qwLast);
+	stats.bOn = 1;
+}
+
+void statcpu(int nPhase, uint64_t qwNow)
+{
+	// reads the thread cpu clock, charging the cpu time since the last
+	// read to nPhase when that read was at the previous lap.
+	struct timespec t;
+	uint64_t qwNs;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	qwNs = ((uint64_t)t.tv_sec * 1000000000) + t.tv_nsec;
+	if(nPhase >= 0 && stats.bCpu)
+	{
+		stats.qwSampleticks[nPhase] += qwNow - stats.qwCputick;
+		stats.qwSamplens[nPhase] += qwNs - stats.qwCpuns;
+	}
+	stats.qwCputick = qwNow;
+	stats.qwCpuns = qwNs;
+	stats.bCpu = 1;
+}
+
+void statlap(int nPhase, uint64_t qwBytes)
+{
+	// charges the ticks since the last lap to nPhase.  The cpu clock is a
+	// system call, so per scan line it is only read for STAT_WINDOW laps
+	// in every STAT_SAMPLE, or until each phase has a sampled lap, and
+	// each phase's cpu time is its wall time scaled by what its sampled
+	// laps used.  Phases run once are always sampled.
+	uint64_t t;
+	int bOnce = nPhase == STAT_SETUP || nPhase == STAT_HEADER || nPhase == STAT_FINISH, bHad;
+
+	if(!stats.bOn) return;
+	t = statclock();
+	stats.qwTicks[nPhase] += t - stats.qwLast;
+	stats.qwBytes[nPhase] += qwBytes;
+	stats.qwLast = t;
+	bHad = stats.qwSampleticks[nPhase] != 0;
+	if(stats.qwCalls[nPhase]++ == 0 && !bOnce) stats.nUnsampled++;
+	if(bOnce || stats.nUnsampled || (stats.qwLaps % STAT_SAMPLE) < STAT_WINDOW)
+	{
+		statcpu(nPhase, t);
+		if(!bOnce && !bHad && stats.qwSampleticks[nPhase]) stats.nUnsampled--;
+	}
+	else
+	{
+		stats.bCpu = 0;
+	}
+	stats.qwLaps++;
+}
+
+void statreport(char *pOp, int nStatus)
+{
+	// closes the finish phase and prints the --stats record, one JSON
+	// object with ticks scaled to seconds by the monotonic clock.
+	static const char *pPhases[STAT_PHASES] = { "setup", "header", "cover", "payload", "transform", "fill", "write", "finish" };
+	const char *pKernel = rowkernels[0].pName;
+	struct timespec t;
+	struct rusage ru;
+	uint64_t qwIO[2], qwNow;
+	double dWall, dScale, dCpu;
+	int i;
+
+	qwNow = statclock();
+	stats.qwTicks[STAT_FINISH] += qwNow - stats.qwLast;
+	stats.qwCalls[STAT_FINISH]++;
+	stats.qwLast = qwNow;
+	statcpu(STAT_FINISH, qwNow);
+	stats.bOn = 0;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	dWall = (t.tv_sec - stats.tStart.tv_sec) + ((t.tv_nsec - stats.tStart.tv_nsec) / 1e9);
+	dScale = qwNow > stats.qwStart ? dWall / (qwNow - stats.qwStart) : 0;
+	getrusage(RUSAGE_SELF, &ru);
+	procio(qwIO);
+	pthread_once(&rowonce, rowinit);
+	for(i = 0; i < sizeof(rowkernels) / sizeof(rowkernels[0]); i++)
+	{
+		if(rowkernels[i].pfnEmbed == pfnembed) pKernel = rowkernels[i].pName;
+	}
+	printf("{\"op\":\"%s\",\"status\":%d,\"kernel\":\"%s\",\"threads\":1,\"wall\":%.6f,\"user\":%.6f,\"sys\":%.6f", pOp, nStatus, pKernel, dWall, ru.ru_utime.tv_sec + (ru.ru_utime.tv_usec / 1e6), ru.ru_stime.tv_sec + (ru.ru_stime.tv_usec / 1e6));
+	printf(",\"peak\":%" PRIu64 ",\"mem_limit\":%" PRIu64 ",\"hugepages\":%" PRIu64 ",\"pinned\":%d", (uint64_t)ru.ru_maxrss * 1024, opts.qwMemlimit, qwHugebytes, nPincpus ? 1 : 0);
+	printf(",\"rows\":%" PRIu64 ",\"reads\":%" PRIu64 ",\"writes\":%" PRIu64 ",\"phases\":{", stats.qwCalls[STAT_COVER], qwIO[0], qwIO[1]);
+	for(i = 0; i < STAT_PHASES; i++)
+	{
+		printf("%s\"%s\":{\"wall\":%.6f,\"cpu\":", i ? "," : "", pPhases[i], stats.qwTicks[i] * dScale);
+		if(stats.qwSampleticks[i])
+		{
+			// one thread, so never more cpu than wall.
+			dCpu = stats.qwSamplens[i] / (stats.qwSampleticks[i] * dScale * 1e9);
+			printf("%.6f", stats.qwTicks[i] * dScale * (dCpu < 1 ? dCpu : 1));
+		}
+		else
+		{
+			printf(stats.qwCalls[i] ? "null" : "0");
+		}
+		printf(",\"calls\":%" PRIu64 ",\"bytes\":%" PRIu64 "}", stats.qwCalls[i], stats.qwBytes[i]);
+	}
+	printf("}}\n");
+}
+
+int cacheopen(FILE *fBMPin, int nFS1, char *pBMPbufhdrin, PCOVERCACHE cc)
+{
+	// maps the --cache sidecar of fBMPin, building it first when there is
+	// none or <bmp in> has changed since.  Returns 0 with the headers in
+	// pBMPbufhdrin, or -1 to encode from fBMPin as usual.
+	char szPath[PATH_MAX];
+	struct stat st;
+
+	if(fstat(fileno(fBMPin), &st) || st.st_size != nFS1) return -1;
+	if(snprintf(szPath, sizeof(szPath), "%s/%016" PRIx64 "-%016" PRIx64 ".bsc", opts.pCache, (uint64_t)st.st_dev, (uint64_t)st.st_ino) >= sizeof(szPath)) return -1;
+	if(cachemap(szPath, &st, cc) && (cachebuild(fBMPin, szPath, &st) || cachemap(szPath, &st, cc)))
+	{
+		rewind(fBMPin);
+
+		return -1;
+	}
+	memcpy(pBMPbufhdrin, cc->pMap + 4, sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER));
+
+	return 0;
+}
+
+int cachebuild(FILE *fBMPin, char *pPath, struct stat *st)
+{
+	// writes the sidecar of a cover that passes validateheader():
+	//  magic "BSC1", the bitmap headers.
+	//  device, inode, size, mtime and ctime of <bmp in>, 8 bytes each.
+	//  HDRCHECK nValid, width, height, data length, stride, padding and
+	//  flags, 4 bytes each, zeros up to COVER_CACHE_HDR.
+	//  every scan line with the embedding bits cleared.
+	//  the cleared bits of every pixel, extractrow() order.
+	// The file is written under a temporary name and renamed, so
+	// concurrent encodes never map half a sidecar.
+	uint8_t hdr[COVER_CACHE_HDR], row[BUF_SIZE], low[BUF_SIZE], zero[BUF_SIZE / 3];
+	char szTmp[PATH_MAX + 16];
+	uint64_t qwId[7];
+	HDRCHECK hc;
+	off_t lLow;
+	int fd, i, ret = -1;
+
+	memset(hdr, 0, sizeof(hdr));
+	memset(zero, 0, sizeof(zero));
+	memcpy(hdr, "BSC1", 4);
+	if(fseeko(fBMPin, 0, SEEK_SET) || fread(hdr + 4, 1, sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER), fBMPin) != sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER)) return -1;
+	hc = validateheader(hdr + 4, (int)st->st_size, 0, 0);
+	if(hc.nValid != HDR_CHECKE_PASS) return -1;
+	qwId[0] = st->st_dev;
+	qwId[1] = st->st_ino;
+	qwId[2] = st->st_size;
+	qwId[3] = st->st_mtim.tv_sec;
+	qwId[4] = st->st_mtim.tv_nsec;
+	qwId[5] = st->st_ctim.tv_sec;
+	qwId[6] = st->st_ctim.tv_nsec;
+	for(i = 0; i < 7; i++) putle(hdr + 58 + (i * 8), qwId[i], 8);
+	putle(hdr + 114, hc.nValid, 4);
+	putle(hdr + 118, hc.nBMPw, 4);
+	putle(hdr + 122, hc.nBMPh, 4);
+	putle(hdr + 126, hc.nBMPdlen, 4);
+	putle(hdr + 130, hc.nStride, 4);
+	putle(hdr + 134, hc.nPadding, 4);
+	putle(hdr + 138, hc.dwFlags, 4);
+	snprintf(szTmp, sizeof(szTmp), "%s.%d", pPath, (int)getpid());
+	if((fd = open(szTmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) return -1;
+	if(pwrite(fd, hdr, sizeof(hdr), 0) != sizeof(hdr)) goto cleanup;
+	lLow = COVER_CACHE_HDR + (off_t)hc.nBMPh * hc.nStride;
+	for(i = 0; i < hc.nBMPh; i++)
+	{
+		if(fread(row, 1, hc.nStride, fBMPin) != hc.nStride) goto cleanup;
+		extractrow(row, low, hc.nBMPw);
+		embedrow(row, zero, hc.nBMPw);
+		if(pwrite(fd, row, hc.nStride, COVER_CACHE_HDR + (off_t)i * hc.nStride) != hc.nStride) goto cleanup;
+		if(pwrite(fd, low, hc.nBMPw, lLow + (off_t)i * hc.nBMPw) != hc.nBMPw) goto cleanup;
+	}
+	if(rename(szTmp, pPath) == 0) ret = 0;
+
+cleanup:
+	close(fd);
+	if(ret) unlink(szTmp);
+
+	return ret;
+}
+
+int cachemap(char *pPath, struct stat *st, PCOVERCACHE cc)
+{
+	// maps pPath when it is the sidecar of the cover st describes.
+	struct stat stc;
+	uint8_t *p;
+	int fd, i;
+
+	memset(cc, 0, sizeof(COVERCACHE));
+	if((fd = open(pPath, O_RDONLY)) < 0) return -1;
+	if(fstat(fd, &stc) || stc.st_size < COVER_CACHE_HDR)
+	{
+		close(fd);
+
+		return -1;
+	}
+	p = (uint8_t *)mmap(NULL, stc.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(p == MAP_FAILED) return -1;
+	// a filesystem with large folios can back the scan lines with huge pages.
+	if(opts.bHuge) madvise(p, stc.st_size, MADV_HUGEPAGE);
+	cc->pMap = p;
+	cc->nMap = stc.st_size;
+	i = memcmp(p, "BSC1", 4) || getle(p + 58, 8) != (uint64_t)st->st_dev || getle(p + 66, 8) != (uint64_t)st->st_ino ||
+	    getle(p + 74, 8) != (uint64_t)st->st_size || getle(p + 82, 8) != (uint64_t)st->st_mtim.tv_sec || getle(p + 90, 8) != (uint64_t)st->st_mtim.tv_nsec ||
+	    getle(p + 98, 8) != (uint64_t)st->st_ctim.tv_sec || getle(p + 106, 8) != (uint64_t)st->st_ctim.tv_nsec;
+	cc->hc.nValid = (int)getle(p + 114, 4);
+	cc->hc.nBMPw = (int)getle(p + 118, 4);
+	cc->hc.nBMPh = (int)getle(p + 122, 4);
+	cc->hc.nBMPdlen = (int)getle(p + 126, 4);
+	cc->hc.nStride = (int)getle(p + 130, 4);
+	cc->hc.nPadding = (int)getle(p + 134, 4);
+	cc->hc.dwFlags = (uint32_t)getle(p + 138, 4);
+	cc->hc.nOffset = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER); // sidecars are only built for BMP covers.
+	if(i || cc->hc.nValid != HDR_CHECKE_PASS || cc->nMap != COVER_CACHE_HDR + ((size_t)cc->hc.nBMPh * (cc->hc.nStride + cc->hc.nBMPw)))
+	{
+		cacheclose(cc);
+
+		return -1;
+	}
+	cc->pRows = p + COVER_CACHE_HDR;
+	cc->pLow = cc->pRows + ((size_t)cc->hc.nBMPh * cc->hc.nStride);
+
+	return 0;
+}
+
+HDRCHECK cachecheck(PCOVERCACHE cc, int j)
+{
+	// validateheader() of the cached cover for j payload pixels.
+	HDRCHECK hc = cc->hc;
+
+	if(((hc.nBMPw * hc.nBMPh) - FILE_SIZE_PIXELS) < j)
+	{
+		hc.nValid--;
+		hc.dwFlags &= ~32768;
+	}
+
+	return hc;
+}
+
+void coverrow(PCOVERCACHE cc, int nRow, uint8_t *pRow, int bRestore)
+{
+	// scan line nRow with its embedding bits cleared, or as it is in
+	// <bmp in> when bRestore is set.
+	memcpy(pRow, cc->pRows + ((size_t)nRow * cc->hc.nStride), cc->hc.nStride);
+	if(bRestore) embedrow(pRow, cc->pLow + ((size_t)nRow * cc->hc.nBMPw), cc->hc.nBMPw);
+}
+
+void cacheclose(PCOVERCACHE cc)
+{
+	if(cc->pMap) munmap(cc->pMap, cc->nMap);
+	cc->pMap = NULL;
+}
+
+int updatesrc(PDATASRC ds, PMEMBER m, PEXTHDR eh, uint8_t *pPrefix, int nPrefix)
+{
+	// payload stream of <data in> behind pPrefix, through the stages the
+	// header flags name.
+	m->fIn = NULL;
+	m->dwCRC = 0;
+	initsrc(ds, pPrefix, nPrefix, m, 1);
+	srccipher(ds, eh);
+	if((eh->wFlags & EXT_FLAG_LZ) && (ds->pLz = (PLZSTREAM)malloc(sizeof(LZSTREAM))) == NULL) return -1;
+	if(ds->pLz) ds->pLz->nOut = ds->pLz->nPos = 0;
+	if((eh->wFlags & EXT_FLAG_FEC) && (ds->pFec = fecnew(eh->nFecparity, eh->nFecdepth)) == NULL) return -1;
+
+	return 0;
+}
+
+void updatefree(PDATASRC ds)
+{
+	closesrc(ds);
+	free(ds->pLz);
+	fecfree(ds->pFec);
+	ds->pLz = NULL;
+	ds->pFec = NULL;
+}
+
+int cmdupdate(int argc, char **argv)
+{
+	// update <bmp> <data in> [<fill>]
+	// The new payload stream is embedded over the old one a scan line at
+	// a time and only the scan lines that differ are written back, so an
+	// edit near the start of a payload rewrites little of <bmp>.  The
+	// cover itself is not needed, embedding only sets the low bits.
+	uint8_t pPrefix[FILE_SIZE_PIXELS + sizeof(((PEXTHDR)0)->bRaw)];
+	char pBMPbufhdrin[HOST_HDR_MAX];
+	uint8_t *pRow = NULL, *pOld = NULL, *pData = NULL;
+	uint64_t qwOld, qwNew, qwPixel;
+	struct stat st;
+	off_t lRow;
+	FILE *fBMP = NULL;
+	HDRCHECK hc;
+	PIXRDR pr;
+	EXTHDR ehOld, eh;
+	DATASRC ds;
+	MEMBER m;
+	int nRF = 0, nPrefix, nRows = 0, nRow, n, nFill, nHdr, bDone = 0, e, ret = -1;
+
+	if(argc != 4 && argc != 5) { usage(); return -1; }
+	if(argc == 5 && ((*argv[4] != 'r' && *argv[4] != 'n' && *argv[4] != 'd' && *argv[4] != 'l') || strlen(argv[4]) != 1)) { usage(); return -1; }
+	if(argc == 5) nRF = fillmode(argv[4]);
+	memset(&ds, 0, sizeof(ds));
+	memset(&m, 0, sizeof(m));
+	if(statpath(argv[3], &st) || st.st_size < 1 || st.st_size > UINT32_MAX)
+	{
+		fprintf(stderr, "ERROR: could not get size of <data in>.\n");
+
+		return -1;
+	}
+	m.pPath = argv[3];
+	m.dwLength = (uint32_t)st.st_size;
+	if((pRow = (uint8_t *)malloc(BUF_SIZE)) == NULL || (pOld = (uint8_t *)malloc(BUF_SIZE)) == NULL || (pData = (uint8_t *)malloc(BUF_SIZE)) == NULL)
+	{
+		fprintf(stderr, "ERROR: unable to allocate scan line buffers.\n");
+		goto cleanup;
+	}
+	if((fBMP = fopenpath(argv[2], "rb+")) == NULL || fstat(fileno(fBMP), &st) || st.st_size > INT32_MAX)
+	{
+		fprintf(stderr, "ERROR: unable to open <bmp>.\n");
+		goto cleanup;
+	}
+	if((nHdr = readhost(fBMP, pBMPbufhdrin, (int)st.st_size)) < 0)
+	{
+		fprintf(stderr, "ERROR: unable to read <bmp> headers.\n");
+		goto cleanup;
+	}
+	// any host format decode takes, scan lines start at hc.nOffset.
+	hc = hostcheck(pBMPbufhdrin, nHdr, (int)st.st_size, 0, 1);
+	if(hc.nValid != HDR_CHECKD_PASS || fseeko(fBMP, hc.nOffset, SEEK_SET))
+	{
+		fprintf(stderr, "ERROR: <bmp> header check failed (%08X).\n", hc.dwFlags);
+		goto cleanup;
+	}
+	pxinit(&pr, fBMP, (char *)pRow, hc);
+	e = readpayloadhdr(&pr, &ehOld);
+	pxclose(&pr);
+	if(e)
+	{
+		if(e == DEC_KEY) fprintf(stderr, "ERROR: <bmp> is encrypted, give --key-file or --key-env.\n");
+		else fprintf(stderr, "ERROR: <bmp> holds no readable payload, code %d.\n", e);
+		goto cleanup;
+	}
+	if(ehOld.wFlags & (EXT_FLAG_ARCHIVE | EXT_FLAG_SHARD | EXT_FLAG_PERM | EXT_FLAG_ADAPT))
+	{
+		fprintf(stderr, "ERROR: archives, shards, --perm and --adaptive payloads cannot be updated, encode again.\n");
+		goto cleanup;
+	}
+	qwOld = FILE_SIZE_PIXELS + ehOld.nHdrlen + ehOld.dwLength;
+	// the new payload keeps the layout of the old one.
+	memset(&eh, 0, sizeof(eh));
+	if(ehOld.nHdrlen == 0)
+	{
+		if(m.dwLength > MAX_DATA_FILE)
+		{
+			fprintf(stderr, "ERROR: <data in> is over the %d bytes <bmp> can hold without an extended header.\n", MAX_DATA_FILE);
+			goto cleanup;
+		}
+		putle(pPrefix, m.dwLength, FILE_SIZE_PIXELS);
+		nPrefix = FILE_SIZE_PIXELS;
+	}
+	else
+	{
+		eh.wFlags = ehOld.wFlags | EXT_FLAG_CRC;
+		eh.dwRaw = m.dwLength;
+		eh.nFecparity = ehOld.nFecparity;
+		eh.nFecdepth = fecdepth(m.dwLength, eh.nFecparity);
+		eh.dwLength = (uint32_t)fecsize(m.dwLength, eh.nFecparity, eh.nFecdepth);
+		// the old keystream over new data would give away the xor of
+		// the two payloads.
+		if((eh.wFlags & EXT_FLAG_CHACHA) && newnonce(&eh))
+		{
+			fprintf(stderr, "ERROR: unable to generate a nonce.\n");
+			goto cleanup;
+		}
+		nPrefix = putexthdr(&eh, pPrefix);
+	}
+	if(eh.wFlags & EXT_FLAG_LZ)
+	{
+		// a compressed body is only known to fit once it has been read.
+		if(updatesrc(&ds, &m, &eh, pPrefix, nPrefix))
+		{
+			fprintf(stderr, "ERROR: unable to allocate payload buffers.\n");
+			goto cleanup;
+		}
+		while((n = readsrc(&ds, pData, BUF_SIZE)) > 0);
+		qwNew = ds.qwPos;
+		updatefree(&ds);
+		if(n < 0)
+		{
+			fprintf(stderr, "ERROR: unable to read <data in>.\n");
+			goto cleanup;
+		}
+	}
+	else
+	{
+		qwNew = nPrefix + eh.dwLength + (eh.nHdrlen ? 0 : m.dwLength);
+	}
+	if(qwNew > (uint64_t)hc.nBMPw * hc.nBMPh)
+	{
+		fprintf(stderr, "ERROR: <data in> does not fit in <bmp>.\n");
+		goto cleanup;
+	}
+	if(updatesrc(&ds, &m, &eh, pPrefix, nPrefix))
+	{
+		fprintf(stderr, "ERROR: unable to allocate payload buffers.\n");
+		goto cleanup;
+	}
+	for(nRow = 0; nRow < hc.nBMPh; nRow++)
+	{
+		n = 0;
+		if(!bDone && (n = readsrc(&ds, pData, hc.nBMPw)) < 0)
+		{
+			fprintf(stderr, "ERROR: unable to read <data in>.\n");
+			goto cleanup;
+		}
+		bDone = n < hc.nBMPw;
+		// pixels of the old payload past the end of the new one.
+		qwPixel = (uint64_t)nRow * hc.nBMPw;
+		nFill = nRF && qwPixel + n < qwOld ? (int)((qwOld - qwPixel < hc.nBMPw ? qwOld - qwPixel : hc.nBMPw) - n) : 0;
+		if(n == 0 && nFill == 0) break;
+		lRow = (off_t)hc.nOffset + (off_t)nRow * hc.nStride;
+		if(pread(fileno(fBMP), pRow, hc.nStride, lRow) != hc.nStride)
+		{
+			fprintf(stderr, "ERROR: unable to read <bmp>.\n");
+			goto cleanup;
+		}
+		memcpy(pOld, pRow, hc.nStride);
+		embedrow(pRow, pData, n);
+		fillrow(pRow + (n * 3), nFill, nRF);
+		if(memcmp(pRow, pOld, hc.nStride) == 0) continue;
+		if(pwrite(fileno(fBMP), pRow, hc.nStride, lRow) != hc.nStride)
+		{
+			fprintf(stderr, "ERROR: unable to write <bmp>.\n");
+			goto cleanup;
+		}
+		nRows++;
+	}
+	// the length and crc32c are known once the body has been read.
+	eh.dwLength = (uint32_t)ds.qwCoded;
+	// pwrite() went around the stdio buffer, which may still hold the old
+	// rows of the header read, fflush() drops it before patchhdr().
+	if(ehOld.nHdrlen && (fflush(fBMP) || patchhdr(fBMP, hc, &eh, &ds, pRow)))
+	{
+		fprintf(stderr, "ERROR: unable to write <bmp>.\n");
+		goto cleanup;
+	}
+	fprintf(stderr, "rewrote %d of %d scan lines.\n", nRows, hc.nBMPh);
+	ret = 0;
+
+cleanup:
+	updatefree(&ds);
+	if(fBMP && fclose(fBMP) && ret == 0)
+	{
+		fprintf(stderr, "ERROR: unable to write <bmp>.\n");
+		ret = -1;
+	}
+	free(pRow);
+	free(pOld);
+	free(pData);
+
+	return ret;
+}
+
+char *pnmword(char *s, char *pEnd, char *pWord, int nWord)
+{
+	// copies the next whitespace delimited word of a netpbm header into
+	// pWord, skipping # comments.  Returns the byte after the word, NULL
+	// when the header ends first or the word is too long.
+	int n = 0;
+
+	for(;;)
+	{
+		while(s < pEnd && isspace((unsigned char)*s)) s++;
+		if(s < pEnd && *s != '#') break;
+		while(s < pEnd && *s != '\n') s++;
+		if(s == pEnd) return NULL;
+	}
+	while(s < pEnd && !isspace((unsigned char)*s) && n < nWord - 1) pWord[n++] = *s++;
+	pWord[n] = '\0';
+
+	return s < pEnd && isspace((unsigned char)*s) ? s : NULL;
+}
+
+HDRCHECK pnmcheck(void *p, int nHdr, int i, int j, int bDecode)
+{
+	// sanity check a netpbm header, binary PPM (P6) or PAM (P7) of depth 3,
+	// both with a maxval of 255.  Scan lines run top down and unpadded,
+	// payload pixels follow the byte order of the file, RGB where a BMP
+	// has BGR.  dwFlags reuses the BMP bits for the same checks.
+	HDRCHECK hc = { 0 };
+	char *s = (char *)p, *pEnd = s + nHdr, szWord[16], szKey[16];
+	long w = 0, h = 0, nDepth = 3, nMax = 0;
+	uint32_t dwNeed;
+
+	if(nHdr >= 2 && s[0] == 'P') hc.dwFlags |= 1; // netpbm signature valid.
+	if(nHdr >= 2 && (s[1] == '6' || s[1] == '7')) hc.dwFlags |= 2; // binary RGB kind.
+	if((hc.dwFlags & 3) != 3) return hc;
+	if(s[1] == '6')
+	{
+		// width, height and maxval, then a single whitespace byte.
+		if((s = pnmword(s + 2, pEnd, szWord, sizeof(szWord))) != NULL) w = atol(szWord);
+		if(s && (s = pnmword(s, pEnd, szWord, sizeof(szWord))) != NULL) h = atol(szWord);
+		if(s && (s = pnmword(s, pEnd, szWord, sizeof(szWord))) != NULL) nMax = atol(szWord);
+		if(s) s++;
+	}
+	else
+	{
+		// KEY value lines up to ENDHDR, TUPLTYPE is not needed.
+		nDepth = 0;
+		for(s += 2; s && (s = pnmword(s, pEnd, szKey, sizeof(szKey))) != NULL && strcmp(szKey, "ENDHDR"); )
+		{
+			if((s = pnmword(s, pEnd, szWord, sizeof(szWord))) == NULL) break;
+			if(!strcmp(szKey, "WIDTH")) w = atol(szWord);
+			else if(!strcmp(szKey, "HEIGHT")) h = atol(szWord);
+			else if(!strcmp(szKey, "DEPTH")) nDepth = atol(szWord);
+			else if(!strcmp(szKey, "MAXVAL")) nMax = atol(szWord);
+		}
+		if(s && *s == '\n') s++;
+		else s = NULL;
+	}
+	if(s) { hc.nOffset = (int)(s - (char *)p); hc.dwFlags |= 8; } // header ends within HOST_HDR_MAX.
+	if(w > 0 && h > 0 && w < BUF_SIZE && h <= INT32_MAX / w) { hc.nBMPw = (int)w; hc.nBMPh = (int)h; }
+	if(bDecode ? (uint64_t)hc.nBMPw * hc.nBMPh > 2 : hc.nBMPw > 0) hc.dwFlags |= 32; // pixel width and height valid.
+	if(nDepth == 3) hc.dwFlags |= 128; // three bytes per pixel.
+	if(nMax == 255) hc.dwFlags |= 256; // one byte per sample.
+	hc.nStride = hc.nBMPw * 3;
+	if(hc.nStride < BUF_SIZE) hc.dwFlags |= 4096; // scan line is not too big.
+	hc.nBMPdlen = i - hc.nOffset;
+	if((hc.dwFlags & 8) && (uint64_t)hc.nBMPdlen == (uint64_t)hc.nBMPh * hc.nStride) hc.dwFlags |= 16384; // image data length is valid for scan line.
+	if(!bDecode && ((uint64_t)hc.nBMPw * hc.nBMPh) - FILE_SIZE_PIXELS >= j) hc.dwFlags |= 32768; // data file fits.
+	// reported against the pass counts of the BMP checks.
+	dwNeed = 1 | 2 | 8 | 32 | 128 | 256 | 4096 | 16384 | (bDecode ? 0 : 32768);
+	if((hc.dwFlags & dwNeed) == dwNeed) hc.nValid = bDecode ? HDR_CHECKD_PASS : HDR_CHECKE_PASS;
+
+	return hc;
+}
+
+HDRCHECK rawcheck(int i, int j, int bDecode)
+{
+	// sanity check a headerless cover of --raw dimensions, BGR pixels in
+	// unpadded scan lines as a BMP would hold them.
+	HDRCHECK hc = { 0 };
+	uint32_t dwNeed;
+
+	if(opts.nRaww < BUF_SIZE && opts.nRawh <= INT32_MAX / opts.nRaww) { hc.nBMPw = opts.nRaww; hc.nBMPh = opts.nRawh; }
+	if(bDecode ? (uint64_t)hc.nBMPw * hc.nBMPh > 2 : hc.nBMPw > 0) hc.dwFlags |= 32; // pixel width and height valid.
+	hc.nStride = hc.nBMPw * 3;
+	if(hc.nStride < BUF_SIZE) hc.dwFlags |= 4096; // scan line is not too big.
+	hc.nBMPdlen = i;
+	if((uint64_t)hc.nBMPdlen == (uint64_t)hc.nBMPh * hc.nStride) hc.dwFlags |= 16384; // file length is valid for scan line.
+	if(!bDecode && ((uint64_t)hc.nBMPw * hc.nBMPh) - FILE_SIZE_PIXELS >= j) hc.dwFlags |= 32768; // data file fits.
+	dwNeed = 32 | 4096 | 16384 | (bDecode ? 0 : 32768);
+	if((hc.dwFlags & dwNeed) == dwNeed) hc.nValid = bDecode ? HDR_CHECKD_PASS : HDR_CHECKE_PASS;
+
+	return hc;
+}
+
+HDRCHECK hostcheck(void *p, int nHdr, int i, int j, int bDecode)
+{
+	// picks the host format of a cover of i bytes from the nHdr bytes
+	// read at p, then runs its checks for j payload pixels, or for
+	// decode.  All formats share the scan line kernels, only the header
+	// and the stride differ.
+	HDRCHECK hc = { 0 };
+
+	if(opts.nRaww) return rawcheck(i, j, bDecode);
+	if(nHdr >= 2 && ((char *)p)[0] == 'P') return pnmcheck(p, nHdr, i, j, bDecode);
+	if(nHdr < sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER)) return hc;
+
+	return validateheader(p, i, j, bDecode);
+}
+
+int readhost(FILE *fBMPin, char *pBMPbufhdrin, int nFS1)
+{
+	// reads up to HOST_HDR_MAX header bytes of <bmp in> into pBMPbufhdrin,
+	// hostcheck() finds where the scan lines start.  Returns the bytes
+	// read or -1.
+	int n = nFS1 < HOST_HDR_MAX ? nFS1 : HOST_HDR_MAX;
+
+	if(opts.nRaww) return 0;
+
+	return fread(pBMPbufhdrin, 1, n, fBMPin) == n ? n : -1;
+}
+
+uint64_t parsesize(char *p)
+{
+	// a byte count with an optional k, m or g suffix, 0 when malformed.
+	char *pEnd;
+	uint64_t q;
+
+	if(*p < '0' || *p > '9') return 0;
+	q = strtoull(p, &pEnd, 10);
+	if((*pEnd | 0x20) == 'k') { q <<= 10; pEnd++; }
+	else if((*pEnd | 0x20) == 'm') { q <<= 20; pEnd++; }
+	else if((*pEnd | 0x20) == 'g') { q <<= 30; pEnd++; }
+
+	return *pEnd ? 0 : q;
+}
+
+int memlimit(void)
+{
+	// caps the data segment at --mem-limit, so an allocation past it fails
+	// and is reported.  Thread stacks are private mappings and count, so
+	// workers get MEM_STACK in place of the default.
+	struct rlimit rl;
+
+	if(getrlimit(RLIMIT_DATA, &rl)) return -1;
+	if(rl.rlim_max != RLIM_INFINITY && rl.rlim_max < opts.qwMemlimit) opts.qwMemlimit = rl.rlim_max;
+	rl.rlim_cur = opts.qwMemlimit;
+	if(setrlimit(RLIMIT_DATA, &rl)) return -1;
+	if(pthread_attr_init(&attrworker) || pthread_attr_setstacksize(&attrworker, MEM_STACK)) return -1;
+
+	return 0;
+}
+
+uint64_t jobmem(uint16_t wFlags, int nW)
+{
+	// heap one encode or decode job holds with the stages in wFlags, the
+	// fec coder at its deepest.  nW sizes the adaptive map, 0 for the
+	// widest scan line.
+	uint64_t q = 2 * BUF_SIZE + 3 * BUFSIZ; // scan line buffers and stdio.
+
+	if(nW == 0) nW = BUF_SIZE / 3;
+	if(wFlags & EXT_FLAG_LZ) q += sizeof(LZSTREAM) + LZ_BOUND(LZ_BLOCK) + LZ_BLOCK;
+	if(wFlags & EXT_FLAG_FEC) q += sizeof(FECCODER) + (uint64_t)(FEC_N + (2 * FEC_MAX_PARITY) + 1) * FEC_DEPTH;
+	if(wFlags & EXT_FLAG_PERM) q += opts.bHuge ? (sizeof(PERMSTREAM) + HUGE_HDR + HUGE_PAGE - 1) & ~(uint64_t)(HUGE_PAGE - 1) : sizeof(PERMSTREAM);
+	if(wFlags & EXT_FLAG_ADAPT) q += sizeof(ADAPTMAP) + 6 * (uint64_t)(nW + 2);
+
+	return q;
+}
+
+int memthreads(int nThreads, uint64_t qwJob)
+{
+	// the most of nThreads workers whose jobs of qwJob bytes and stacks
+	// fit --mem-limit, never fewer than one.
+	uint64_t qwFree;
+
+	if(opts.qwMemlimit == 0) return nThreads;
+	qwFree = opts.qwMemlimit > MEM_RESERVE ? opts.qwMemlimit - MEM_RESERVE : 0;
+	if((uint64_t)nThreads > qwFree / (qwJob + MEM_STACK)) nThreads = (int)(qwFree / (qwJob + MEM_STACK));
+
+	return nThreads < 1 ? 1 : nThreads;
+}
+
+pthread_attr_t *workerattr(void)
+{
+	// attributes for pthread_create(), the defaults without --mem-limit.
+	return opts.qwMemlimit ? &attrworker : NULL;
+}
+
+void watchstop(int nSig)
+{
+	bWatchstop = 1;
+}
+
+int watchscan(PWATCHCTX wc)
+{
+	// queues the files already in the spool directory, and those whose
+	// events were lost to an overflow.
+	struct dirent *de;
+	DIR *d;
+	char *p;
+
+	if((d = opendir(wc->pSpool)) == NULL) return -1;
+	while((de = readdir(d)) != NULL)
+	{
+		if(de->d_name[0] == '.' || (de->d_type != DT_REG && de->d_type != DT_UNKNOWN)) continue;
+		if((p = strdup(de->d_name)) != NULL) qput(&wc->q, p);
+	}
+	closedir(d);
+
+	return 0;
+}
 
-	return hc;
+int watchjob(PWATCHCTX wc, char *pName)
+{
+	// claims pName by renaming it to a dot name, so a file queued twice
+	// runs once, then runs this program on it with the same options.  A
+	// fresh process is spawned rather than forked, as only
+	// async-signal-safe calls may follow a fork with workers running.
+	// It gets a process group of its own, so an interrupt stops the watch
+	// and lets running jobs finish.  The output is written under a dot
+	// name in the done directory and renamed into place when complete.
+	char *pIn = NULL, *pWork = NULL, *pTmp = NULL, *pOut = NULL, **ppArgs = NULL;
+	size_t nSpool = strlen(wc->pSpool), nDone = strlen(wc->pDone), nName = strlen(pName);
+	posix_spawnattr_t sa;
+	struct stat st;
+	pid_t pid;
+	int nStatus, k, e = -1;
+
+	pIn = (char *)malloc(nSpool + nName + 2);
+	pWork = (char *)malloc(nSpool + nName + 16);
+	pTmp = (char *)malloc(nDone + nName + 16);
+	pOut = (char *)malloc(nDone + nName + 16);
+	ppArgs = (char **)malloc((wc->nOpts + 7) * sizeof(char *));
+	if(pIn == NULL || pWork == NULL || pTmp == NULL || pOut == NULL || ppArgs == NULL) goto cleanup;
+	sprintf(pIn, "%s/%s", wc->pSpool, pName);
+	sprintf(pWork, "%s/.%s.work", wc->pSpool, pName);
+	sprintf(pTmp, "%s/.%s.tmp", wc->pDone, pName);
+	sprintf(pOut, "%s/%s.%s", wc->pDone, pName, *wc->pMode == 'e' ? "bmp" : "out");
+	// gone or claimed already, nothing to do.
+	if(lstat(pIn, &st) || !S_ISREG(st.st_mode) || rename(pIn, pWork))
+	{
+		e = 1;
+		goto cleanup;
+	}
+	ppArgs[0] = wc->pArgv0;
+	memcpy(ppArgs + 1, wc->ppOpts, wc->nOpts * sizeof(char *));
+	k = wc->nOpts + 1;
+	ppArgs[k++] = wc->pMode;
+	ppArgs[k++] = *wc->pMode == 'e' ? wc->pBMPin : pWork;
+	ppArgs[k++] = *wc->pMode == 'e' ? pWork : pTmp;
+	if(*wc->pMode == 'e')
+	{
+		ppArgs[k++] = pTmp;
+		ppArgs[k++] = wc->pFill;
+	}
+	ppArgs[k] = NULL;
+	pid = -1;
+	if(posix_spawnattr_init(&sa) == 0)
+	{
+		if(posix_spawnattr_setflags(&sa, POSIX_SPAWN_SETPGROUP) || posix_spawnattr_setpgroup(&sa, 0) || posix_spawn(&pid, "/proc/self/exe", NULL, &sa, ppArgs, environ)) pid = -1;
+		posix_spawnattr_destroy(&sa);
+	}
+	if(pid > 0 && waitpid(pid, &nStatus, 0) == pid && WIFEXITED(nStatus) && WEXITSTATUS(nStatus) == 0 && rename(pTmp, pOut) == 0)
+	{
+		unlink(pWork);
+		e = 0;
+	}
+	else
+	{
+		unlink(pTmp);
+		sprintf(pTmp, "%s/.%s.failed", wc->pSpool, pName);
+		rename(pWork, pTmp);
+	}
+
+cleanup:
+	free(pIn);
+	free(pWork);
+	free(pTmp);
+	free(pOut);
+	free(ppArgs);
+
+	return e;
 }
 
-int encode(FILE *fBMPin, FILE *fDatain, FILE *fFileout, char *pBMPbufin, char *pDatabufin, HDRCHECK hc, int nFS2, int nRF)
+void *watchworker(void *p)
 {
-	// encodes <bmp out> from <bmp in> and <data in>.
-	// Each byte from <data in> is spread across low-order BGR bits.
-	// Some studies suggest that the eye is more sensitive to changes
-	// in green. So only 2 bits will be robbed from G, while 3 bits
-	// will be robbed from B and R. 2 bits represents 1.5% of the
-	// color space, 3 bits represents 3.1% of the color space.
-	// The first two pixels store the number of bytes embedded in
-	// the remaining pixels.
-	//  fBMPin at start of image data in <bmp in>.
-	//  fDatain at head of <data in>.
-	//  fFileout at start of image data of <bmp out>.
-	//  pBMPbufin head of buffer to read scan lines from <bmp in>.
-	//  pDatabufin head of buffer to read bytes from <data in>.
-	//  hc context values for reading, writing and encoding.
-	//  nFS1 size of entire <bmp in> file.
-	//  nFS2 size of entire <data in> file.
-	//  nRF 1 to random fill unused bytes, 2 for dark fill, 3 for
-	//      light fill, 0 no fill.
-	// BMP data starts at the bottom lefthand corner of the image.
-	union
+	// runs queued jobs and prints one line per file, queued files are
+	// dropped once stopped.
+	PWATCHCTX wc = (PWATCHCTX)p;
+	char *pName;
+	int e;
+
+	pinworker();
+	while((pName = qget(&wc->q)) != NULL)
 	{
-		uint16_t w;
-		uint8_t c[2];
-	} dfs;
-	int wpels, hpels, state = 0;
-	char *pC; // BGR pixel pointer in current stride.
-	uint8_t dibyte, mask = 0x29; // B_G_R encoding mask in binary = 001_01_001
-                                     // white = 0xffffff, black = 0x000000
+		if(!bWatchstop && (e = watchjob(wc, pName)) <= 0)
+		{
+			__atomic_fetch_add(e ? &wc->nFailed : &wc->nDone, 1, __ATOMIC_RELAXED);
+			printf("%-6s  %s\n", e ? "failed" : "done", pName);
+			fflush(stdout);
+		}
+		free(pName);
+	}
 
-	dfs.w = (uint16_t)nFS2;
-	wpels = hc.nBMPw;
-	hpels = hc.nBMPh;
-	pC = pBMPbufin;
-	if(fread(pBMPbufin, 1, hc.nStride, fBMPin) != hc.nStride) return -1;
-	// encode low-order byte of <data in> file size.
-	*pC &= 0xf8;
-	*(pC + 1) &= 0xfc;
-	*(pC + 2) &= 0xf8;
-	*pC |= dfs.c[0] & 0x7;
-	*(pC + 1) |= (dfs.c[0] >> 3) & 0x3;
-	*(pC + 2) |= (dfs.c[0] >> 5) & 0x7;
-	if(--wpels)
-	{
-		// encode high-order byte of <data in> file size.
-		pC += 3;
-		*pC &= 0xf8;
-		*(pC + 1) &= 0xfc;
-		*(pC + 2) &= 0xf8;
-		*pC |= dfs.c[1] & 0x7;
-		*(pC + 1) |= (dfs.c[1] >> 3) & 0x3;
-		*(pC + 2) |= (dfs.c[1] >> 5) & 0x7;
+	return NULL;
+}
+
+int cmdwatch(int argc, char **argv)
+{
+	// watch [-j <threads>] e <spool dir> <done dir> <bmp in> <fill>
+	// watch [-j <threads>] d <spool dir> <done dir>
+	// Completed files are IN_CLOSE_WRITE in the spool directory, or
+	// IN_MOVED_TO for those written elsewhere and renamed in.
+	char buf[16 * (sizeof(struct inotify_event) + NAME_MAX + 1)] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *ie;
+	struct sigaction sa;
+	struct pollfd pfd;
+	pthread_t *pThreads = NULL;
+	WATCHCTX wc;
+	ssize_t n;
+	char *p, *pName;
+	int nThreads, nStarted = 0, fd = -1, i = 2, ret = -1;
+
+	nThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if(argc > 3 && !strcmp(argv[2], "-j"))
+	{
+		nThreads = atoi(argv[3]);
+		i = 4;
 	}
-	else
+	if(nThreads < 1 || argc - i < 3) { usage(); return -1; }
+	if(ppOptwords == NULL)
 	{
-		// is a 1 pixel wide BMP, write updated pixel and read new scan line.
-		// encode high-order byte of <data in> file size.
-		if(--hpels == 0) return -2;
-		wpels = hc.nBMPw;
-		if(fwrite(pBMPbufin, 1, hc.nStride, fFileout) != hc.nStride) return -3;
-		if(fread(pBMPbufin, 1, hc.nStride, fBMPin) != hc.nStride) return -4;
-		*pC &= 0xf8;
-		*(pC + 1) &= 0xfc;
-		*(pC + 2) &= 0xf8;
-		*pC |= dfs.c[1] & 0x7;
-		*(pC + 1) |= (dfs.c[1] >> 3) & 0x3;
-		*(pC + 2) |= (dfs.c[1] >> 5) & 0x7;
-	}
-	// file size of <data in> encoding complete.
-	if(--wpels)
-	{
-		// is at least a 3 pixel wide BMP. first <data in> byte write to current scan line.
-		pC += 3;
+		fprintf(stderr, "ERROR: unable to allocate watch queue.\n");
+
+		return -1;
 	}
-	else
+	memset(&wc, 0, sizeof(wc));
+	wc.pArgv0 = argv[0];
+	wc.ppOpts = ppOptwords + 1;
+	wc.nOpts = nOptwords;
+	wc.pMode = argv[i];
+	wc.pSpool = argv[i + 1];
+	wc.pDone = argv[i + 2];
+	if(!strcmp(wc.pMode, "e") && argc - i == 5)
+	{
+		wc.pBMPin = argv[i + 3];
+		wc.pFill = argv[i + 4];
+		if((*wc.pFill != 'r' && *wc.pFill != 'n' && *wc.pFill != 'd' && *wc.pFill != 'l') || strlen(wc.pFill) != 1) { usage(); return -1; }
+	}
+	else if(strcmp(wc.pMode, "d") || argc - i != 3)
+	{
+		usage();
+
+		return -1;
+	}
+	nThreads = memthreads(nThreads, jobmem(0xffff, 0));
+	if((wc.q.ppPaths = (char **)malloc(PROBE_QUEUE * sizeof(char *))) == NULL || (pThreads = (pthread_t *)malloc(nThreads * sizeof(pthread_t))) == NULL)
+	{
+		fprintf(stderr, "ERROR: unable to allocate watch queue.\n");
+		free(wc.q.ppPaths);
+
+		return -1;
+	}
+	qinit(&wc.q, PROBE_QUEUE);
+	if((fd = inotify_init1(IN_CLOEXEC)) < 0 || inotify_add_watch(fd, wc.pSpool, IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR) < 0)
+	{
+		fprintf(stderr, "ERROR: unable to watch <spool dir>.\n");
+		goto cleanup;
+	}
+	// no SA_RESTART, so poll() returns on a signal.
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = watchstop;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	while(nStarted < nThreads && pthread_create(&pThreads[nStarted], workerattr(), watchworker, &wc) == 0) nStarted++;
+	if(nStarted == 0)
+	{
+		fprintf(stderr, "ERROR: unable to start watch workers.\n");
+		goto cleanup;
+	}
+	// files spooled before the watch was added.
+	if(watchscan(&wc))
 	{
-		// is a 1 or 2 pixel wide BMP, write updated pixels and read new scan line.
-		if(--hpels == 0) return -5;
-		wpels = hc.nBMPw;
-		if(fwrite(pBMPbufin, 1, hc.nStride, fFileout) != hc.nStride) return -6;
-		if(fread(pBMPbufin, 1, hc.nStride, fBMPin) != hc.nStride) return -7;
-		pC = pBMPbufin;
+		fprintf(stderr, "ERROR: unable to read <spool dir>.\n");
+		bWatchstop = 1;
 	}
-	// encode <data in> bytes into <bmp in> scan lines. pC points to next BGR to modify.
-	while(hpels)
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while(!bWatchstop)
 	{
-		// state == 0 use <data in> byte, 1 rand fill, 2 dark fill, 3 light fill, -1 no fill
-		switch(state)
+		if(poll(&pfd, 1, -1) < 1 || (n = read(fd, buf, sizeof(buf))) < 1) continue;
+		for(p = buf; p < buf + n; p += sizeof(struct inotify_event) + ie->len)
 		{
-			case 0:
-				if(fread(pDatabufin, 1, 1, fDatain) != 1)
-				{
-					// no more data to read, gen random byte.
-					state = (nRF ? nRF : -1);
-					dibyte = (uint8_t)rand();
-					if(state == 2) dibyte &= mask; // darken (more 0s)
-					if(state == 3) dibyte |= ~mask; // lighten (more 1s)
-				}
-				else
-				{
-					dibyte = *pDatabufin;
-				}
-				break;
-			case 1:
-					dibyte = (uint8_t)rand();
-				break;
-			case 2:
-					dibyte = (uint8_t)rand();
-					dibyte &= mask; // darken (more 0s)
-				break;
-			case 3:
-					dibyte = (uint8_t)rand();
-					dibyte |= ~mask; // lighten (more 1s)
-				break;
-			case 4:
-				// do nothing
-				break;
-			default:
-				break;
+			ie = (struct inotify_event *)p;
+			if(ie->mask & IN_Q_OVERFLOW) watchscan(&wc);
+			if(ie->len == 0 || ie->name[0] == '.' || (ie->mask & IN_ISDIR)) continue;
+			if((pName = strdup(ie->name)) != NULL) qput(&wc.q, pName);
+		}
+	}
+	ret = 0;
+
+cleanup:
+	qdone(&wc.q);
+	for(i = 0; i < nStarted; i++) pthread_join(pThreads[i], NULL);
+	if(nStarted) fprintf(stderr, "watched %d files: %d done, %d failed.\n", wc.nDone + wc.nFailed, wc.nDone, wc.nFailed);
+	if(fd >= 0) close(fd);
+	while(wc.q.nCount)
+	{
+		free(wc.q.ppPaths[wc.q.nHead]);
+		wc.q.nHead = (wc.q.nHead + 1) % wc.q.nCap;
+		wc.q.nCount--;
+	}
+	free(wc.q.ppPaths);
+	free(pThreads);
+
+	return ret;
+}
+
+int pathfd(char *pPath, int nFlags)
+{
+	// opens a file name, fd:<n> for an inherited descriptor or shm:/<name>
+	// for a POSIX shared memory object.  Descriptors are reopened through
+	// /proc, so every open has its own offset as split's workers need.
+	char szProc[32];
+
+	if(!strncmp(pPath, "fd:", 3))
+	{
+		snprintf(szProc, sizeof(szProc), "/proc/self/fd/%d", atoi(pPath + 3));
+
+		return open(szProc, nFlags, 0600);
+	}
+	if(!strncmp(pPath, "shm:", 4)) return shm_open(pPath + 4, nFlags, 0600);
+
+	return open(pPath, nFlags, 0666);
+}
+
+FILE *fopenpath(char *pPath, char *pMode)
+{
+	// fopen() taking the names pathfd() does.
+	FILE *f;
+	int fd;
+
+	if(strncmp(pPath, "fd:", 3) && strncmp(pPath, "shm:", 4)) return fopen(pPath, pMode);
+	if((fd = pathfd(pPath, O_CLOEXEC | (*pMode != 'r' ? O_RDWR | O_CREAT | O_TRUNC : strchr(pMode, '+') ? O_RDWR : O_RDONLY))) < 0) return NULL;
+	if((f = fdopen(fd, pMode)) == NULL) close(fd);
+
+	return f;
+}
+
+int statpath(char *pPath, struct stat *st)
+{
+	// stat() taking the names pathfd() does.
+	int fd, e;
+
+	if(strncmp(pPath, "fd:", 3) && strncmp(pPath, "shm:", 4)) return stat(pPath, st);
+	if((fd = pathfd(pPath, O_RDONLY | O_CLOEXEC)) < 0) return -1;
+	e = fstat(fd, st);
+	close(fd);
+
+	return e;
+}
+
+int removepath(char *pPath)
+{
+	// drops a partial output, a descriptor the caller owns is emptied.
+	int fd;
+
+	if(!strncmp(pPath, "shm:", 4)) return shm_unlink(pPath + 4);
+	if(strncmp(pPath, "fd:", 3)) return remove(pPath);
+	if((fd = pathfd(pPath, O_WRONLY | O_TRUNC | O_CLOEXEC)) < 0) return -1;
+
+	return close(fd);
+}
+
+void tarheader(uint8_t *p, char *pName, uint64_t qwSize, time_t t, char cType)
+{
+	// ustar header block, names over 100 bytes are cut, see tarput().
+	uint32_t dwSum = 0;
+	int i;
+
+	memset(p, 0, TAR_BLOCK);
+	strncpy((char *)p, pName, 100);
+	sprintf((char *)p + 100, "%07o", 0644);
+	sprintf((char *)p + 108, "%07o", 0);
+	sprintf((char *)p + 116, "%07o", 0);
+	sprintf((char *)p + 124, "%011" PRIo64, qwSize);
+	sprintf((char *)p + 136, "%011" PRIo64, (uint64_t)(t > 0 ? t : 0));
+	p[156] = cType;
+	memcpy(p + 257, "ustar", 6);
+	memcpy(p + 263, "00", 2);
+	// the checksum is taken with its own field as spaces.
+	memset(p + 148, ' ', 8);
+	for(i = 0; i < TAR_BLOCK; i++) dwSum += p[i];
+	sprintf((char *)p + 148, "%06o", dwSum);
+}
+
+int tarwrite(FILE *f, uint8_t *pHdr, const char *pData, size_t n)
+{
+	// a header block and its data padded to whole blocks.
+	static const uint8_t bZero[TAR_BLOCK] = { 0 };
+	size_t nPad = (TAR_BLOCK - (n % TAR_BLOCK)) % TAR_BLOCK;
+
+	if(fwrite(pHdr, 1, TAR_BLOCK, f) != TAR_BLOCK || fwrite(pData, 1, n, f) != n || fwrite(bZero, 1, nPad, f) != nPad) return -1;
+
+	return 0;
+}
+
+int tarput(FILE *f, char *pName, const char *pData, size_t n, time_t t)
+{
+	// one tar member, preceded by a pax path record when the name is
+	// over 100 bytes.  Returns 0 or -1 when the stream cannot be written.
+	uint8_t blk[TAR_BLOCK];
+	size_t nName = strlen(pName), nRec, k;
+	char *pRec;
+	int e;
+
+	if(nName > 100)
+	{
+		// "<length> path=<name>\n", the length counting its own digits.
+		for(nRec = nName + 8; (k = nName + 7 + (size_t)snprintf(NULL, 0, "%zu", nRec)) != nRec; nRec = k);
+		if((pRec = (char *)malloc(nRec + 1)) == NULL) return -1;
+		snprintf(pRec, nRec + 1, "%zu path=%s\n", nRec, pName);
+		tarheader(blk, "PaxHeader", nRec, t, 'x');
+		e = tarwrite(f, blk, pRec, nRec);
+		free(pRec);
+		if(e) return -1;
+	}
+	tarheader(blk, pName, n, t, '0');
+
+	return tarwrite(f, blk, pData, n);
+}
+
+int bulkdecode(PBULKREC r, char *pBMPbufhdrin, char *pBMPbufin)
+{
+	// decodes the cover at r->pPath into memory.  Returns 0, a decode()
+	// error, or -1 when it has no readable payload.
+	struct stat st;
+	FILE *fBMPin, *fOut;
+	HDRCHECK hc;
+	int nHdr, e = -1;
+
+	if((fBMPin = fopenpath(r->pPath, "rb")) == NULL) return -1;
+	if(fstat(fileno(fBMPin), &st) == 0 && st.st_size <= INT32_MAX && st.st_size >= (sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + MIN_DATA) && (nHdr = readhost(fBMPin, pBMPbufhdrin, (int)st.st_size)) >= 0)
+	{
+		r->tMtime = st.st_mtime;
+		hc = hostcheck(pBMPbufhdrin, nHdr, (int)st.st_size, 0, 1);
+		if(hc.nValid == HDR_CHECKD_PASS && fseeko(fBMPin, hc.nOffset, SEEK_SET) == 0 && (fOut = open_memstream(&r->pData, &r->nData)) != NULL)
+		{
+			e = decode(fBMPin, fOut, pBMPbufin, hc, NULL);
+			if(fclose(fOut) && e == 0) e = -1;
 		}
-		if(state > -1)
+	}
+	fclose(fBMPin);
+	if(e)
+	{
+		free(r->pData);
+		r->pData = NULL;
+		r->nData = 0;
+	}
+
+	return e;
+}
+
+void bulkput(PBULKCTX bc, PBULKREC r)
+{
+	// hands a decoded cover to the writer.  Blocks while BULK_RECORDS
+	// covers or nLimit bytes are ahead of it, except for the cover the
+	// writer waits on, so -s cannot stall on a full ring.
+	uint64_t qwSlot;
+
+	pthread_mutex_lock(&bc->mtx);
+	for(;;)
+	{
+		qwSlot = bc->bSorted ? r->qwSeq : bc->qwIn;
+		if(qwSlot == bc->qwNext || (qwSlot - bc->qwNext < BULK_RECORDS && bc->nHeld + r->nData <= bc->nLimit)) break;
+		pthread_cond_wait(&bc->cvPut, &bc->mtx);
+	}
+	if(!bc->bSorted) bc->qwIn++;
+	bc->ppRing[qwSlot % BULK_RECORDS] = r;
+	bc->nHeld += r->nData;
+	pthread_cond_signal(&bc->cvGet);
+	pthread_mutex_unlock(&bc->mtx);
+}
+
+void *bulkworker(void *p)
+{
+	// decodes queued paths.  Failures are handed on as well, so with -s
+	// the writer never waits on a sequence that will not come.
+	PBULKCTX bc = (PBULKCTX)p;
+	char pBMPbufhdrin[HOST_HDR_MAX], *pBMPbufin;
+	PBULKREC r;
+	uint64_t qwSeq;
+	char *pPath;
+
+	pinworker();
+	pBMPbufin = (char *)malloc(BUF_SIZE);
+	for(;;)
+	{
+		pthread_mutex_lock(&bc->mtxSeq);
+		if((pPath = qget(&bc->q)) != NULL) qwSeq = bc->qwSeq++;
+		pthread_mutex_unlock(&bc->mtxSeq);
+		if(pPath == NULL) break;
+		while((r = (PBULKREC)calloc(1, sizeof(BULKREC))) == NULL) sched_yield();
+		r->pPath = pPath;
+		r->qwSeq = qwSeq;
+		r->e = pBMPbufin ? bulkdecode(r, pBMPbufhdrin, pBMPbufin) : -5;
+		bulkput(bc, r);
+	}
+	free(pBMPbufin);
+	pthread_mutex_lock(&bc->mtx);
+	bc->nRunning--;
+	pthread_cond_signal(&bc->cvGet);
+	pthread_mutex_unlock(&bc->mtx);
+
+	return NULL;
+}
+
+void *bulkwriter(void *p)
+{
+	// writes each cover's payload as <path>.out, the leading / dropped,
+	// and reports the skipped ones.  After a write error it only drains
+	// the ring.
+	PBULKCTX bc = (PBULKCTX)p;
+	PBULKREC r;
+	char *pName, *pMember;
+	const char *pWhy;
+
+	pthread_mutex_lock(&bc->mtx);
+	for(;;)
+	{
+		while((r = bc->ppRing[bc->qwNext % BULK_RECORDS]) == NULL && bc->nRunning) pthread_cond_wait(&bc->cvGet, &bc->mtx);
+		if(r == NULL) break;
+		pthread_mutex_unlock(&bc->mtx);
+		if(r->e)
 		{
-			// fill with read or generated byte.
-			*pC &= 0xf8;
-			*(pC + 1) &= 0xfc;
-			*(pC + 2) &= 0xf8;
-			*pC |= dibyte & 0x7;
-			*(pC + 1) |= (dibyte >> 3) & 0x3;
-			*(pC + 2) |= (dibyte >> 5) & 0x7;
+			if(r->e == DEC_ARCHIVE) pWhy = "holds an archive, use extract";
+			else if(r->e == DEC_SHARD) pWhy = "holds a shard, use join";
+			else if(r->e == DEC_CRC) pWhy = "does not match its checksum";
+			else if(r->e == DEC_KEY) pWhy = "is encrypted, give --key-file or --key-env";
+			else if(r->e == DEC_FEC) pWhy = "has too many damaged pixels";
+			else pWhy = "has no readable payload";
+			fprintf(stderr, "skipped  %s, %s.\n", r->pPath, pWhy);
+			bc->nSkipped++;
 		}
-		if(--wpels)
+		else if(!bc->bFailed)
 		{
-			// more pixels in the current scan line
-			pC += 3;
+			pName = r->pPath + strspn(r->pPath, "/");
+			if((pMember = (char *)malloc(strlen(pName) + 5)) == NULL) bc->bFailed = 1;
+			else
+			{
+				sprintf(pMember, "%s.out", pName);
+				if(tarput(bc->fOut, pMember, r->pData, r->nData, r->tMtime)) bc->bFailed = 1;
+				else bc->nDone++;
+				free(pMember);
+			}
 		}
-		else
+		pthread_mutex_lock(&bc->mtx);
+		bc->ppRing[bc->qwNext % BULK_RECORDS] = NULL;
+		bc->qwNext++;
+		bc->nHeld -= r->nData;
+		pthread_cond_broadcast(&bc->cvPut);
+		free(r->pData);
+		free(r->pPath);
+		free(r);
+	}
+	pthread_mutex_unlock(&bc->mtx);
+
+	return NULL;
+}
+
+void *bulkcollect(void *p)
+{
+	// gathers the walk for -s, paths that cannot be kept are dropped.
+	PBULKCTX bc = (PBULKCTX)p;
+	char *pPath, **pp;
+
+	while((pPath = qget(&bc->qWalk)) != NULL)
+	{
+		if(bc->nSorted == bc->nSortcap)
 		{
-			// write updated pixels and read new scan line.
-			wpels = hc.nBMPw;
-			if(fwrite(pBMPbufin, 1, hc.nStride, fFileout) != hc.nStride) return -8;
-			if(--hpels)
+			if((pp = (char **)realloc(bc->ppSorted, (bc->nSortcap ? 2 * bc->nSortcap : PROBE_QUEUE) * sizeof(char *))) == NULL)
 			{
-				if(fread(pBMPbufin, 1, hc.nStride, fBMPin) != hc.nStride) return -9;
-				pC = pBMPbufin;
+				fprintf(stderr, "skipped  %s, out of memory.\n", pPath);
+				free(pPath);
+				continue;
 			}
+			bc->ppSorted = pp;
+			bc->nSortcap = bc->nSortcap ? 2 * bc->nSortcap : PROBE_QUEUE;
 		}
+		bc->ppSorted[bc->nSorted++] = pPath;
 	}
 
-	return 0;
+	return NULL;
 }
 
-int decode(FILE *fBMPin, FILE *fFileout, char *pBMPbufin, HDRCHECK hc)
+int cmppath(const void *a, const void *b)
 {
-	// decodes <data out> from <bmp in>.
-	//  fBMPin at start of image data in <bmp in>.
-	union
+	return strcmp(*(char **)a, *(char **)b);
+}
+
+int cmdbulk(int argc, char **argv)
+{
+	// bulk [-j <threads>] [-s] <tar out> <path>...
+	// Workers decode into memory and a writer thread streams the tar, the
+	// walk stays on this thread as in probe.
+	static const uint8_t bEnd[2 * TAR_BLOCK] = { 0 };
+	pthread_t *pThreads = NULL, tWriter, tCollect;
+	BULKCTX bc;
+	char *pTarout;
+	int nThreads, nStarted = 0, nErr = 0, bWriter = 0, i = 2, k, ret = -1;
+
+	memset(&bc, 0, sizeof(bc));
+	qinit(&bc.q, PROBE_QUEUE);
+	qinit(&bc.qWalk, PROBE_QUEUE);
+	pthread_mutex_init(&bc.mtxSeq, NULL);
+	pthread_mutex_init(&bc.mtx, NULL);
+	pthread_cond_init(&bc.cvPut, NULL);
+	pthread_cond_init(&bc.cvGet, NULL);
+	nThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	for(; i < argc && *argv[i] == '-'; i++)
 	{
-		uint16_t w;
-		uint8_t c[2];
-	} dfs;
-	int wpels, hpels;
-	char *pC; // BGR pixel pointer in current stride.
-	uint8_t dobyte;
-
-	wpels = hc.nBMPw;
-	hpels = hc.nBMPh;
-	pC = pBMPbufin;
-	if(fread(pBMPbufin, 1, hc.nStride, fBMPin) != hc.nStride) return -1;
-	// decode embedded data size low-order byte.
-	dfs.c[0] = 0;
-	dfs.c[0] |= *pC & 0x7;
-	dfs.c[0] |= (*(pC + 1) & 0x3) << 3;
-	dfs.c[0] |= (*(pC + 2) & 0x7) << 5;
-	// decode embedded data high-order byte.
-	if(--wpels)
-	{
-		// is not 1 pixel wide, get next BGR.
-		pC += 3;
-		dfs.c[1] = 0;
-		dfs.c[1] |= *pC & 0x7;
-		dfs.c[1] |= (*(pC + 1) & 0x3) << 3;
-		dfs.c[1] |= (*(pC + 2) & 0x7) << 5;
+		if(!strcmp(argv[i], "-s")) bc.bSorted = 1;
+		else if(!strcmp(argv[i], "-j") && i + 1 < argc) nThreads = atoi(argv[++i]);
+		else break;
+	}
+	if(argc - i < 2 || nThreads < 1) { usage(); return -1; }
+	pTarout = argv[i++];
+	nThreads = memthreads(nThreads, jobmem(0xffff, 0));
+	bc.nLimit = BULK_BUFFER;
+	if(opts.qwMemlimit && bc.nLimit > opts.qwMemlimit / 4) bc.nLimit = opts.qwMemlimit / 4;
+	if((bc.q.ppPaths = (char **)malloc(PROBE_QUEUE * sizeof(char *))) == NULL || (bc.ppRing = (PBULKREC *)calloc(BULK_RECORDS, sizeof(PBULKREC))) == NULL || (pThreads = (pthread_t *)malloc(nThreads * sizeof(pthread_t))) == NULL || (bc.bSorted && (bc.qWalk.ppPaths = (char **)malloc(PROBE_QUEUE * sizeof(char *))) == NULL))
+	{
+		fprintf(stderr, "ERROR: unable to allocate bulk queues.\n");
+		goto cleanup;
+	}
+	if((bc.fOut = fopenpath(pTarout, "wb")) == NULL)
+	{
+		fprintf(stderr, "ERROR: unable to open <tar out>.\n");
+		goto cleanup;
+	}
+	// the writer runs until every worker is done and the ring is empty.
+	bc.nRunning = nThreads;
+	if(pthread_create(&tWriter, workerattr(), bulkwriter, &bc))
+	{
+		fprintf(stderr, "ERROR: unable to start the tar writer.\n");
+		goto cleanup;
+	}
+	bWriter = 1;
+	while(nStarted < nThreads && pthread_create(&pThreads[nStarted], workerattr(), bulkworker, &bc) == 0) nStarted++;
+	pthread_mutex_lock(&bc.mtx);
+	bc.nRunning -= nThreads - nStarted;
+	pthread_cond_signal(&bc.cvGet);
+	pthread_mutex_unlock(&bc.mtx);
+	if(nStarted == 0)
+	{
+		fprintf(stderr, "ERROR: unable to start bulk workers.\n");
+		goto cleanup;
+	}
+	if(bc.bSorted)
+	{
+		// the whole walk is gathered and sorted before any is decoded.
+		if(pthread_create(&tCollect, workerattr(), bulkcollect, &bc))
+		{
+			fprintf(stderr, "ERROR: unable to start the path sort.\n");
+			goto cleanup;
+		}
+		for(k = i; k < argc; k++) nErr += walkpath(&bc.qWalk, argv[k], 1);
+		qdone(&bc.qWalk);
+		pthread_join(tCollect, NULL);
+		qsort(bc.ppSorted, bc.nSorted, sizeof(char *), cmppath);
+		for(k = 0; k < bc.nSorted; k++) qput(&bc.q, bc.ppSorted[k]);
 	}
 	else
 	{
-		// is a 1 pixel wide BMP read new scan line.
-		if(--hpels == 0) return -2;
-		wpels = hc.nBMPw;
-		if(fread(pBMPbufin, 1, hc.nStride, fBMPin) != hc.nStride) return -3;
-		dfs.c[1] = 0;
-		dfs.c[1] |= *pC & 0x7;
-		dfs.c[1] |= (*(pC + 1) & 0x3) << 3;
-		dfs.c[1] |= (*(pC + 2) & 0x7) << 5;
+		for(k = i; k < argc; k++) nErr += walkpath(&bc.q, argv[k], 1);
 	}
-	if((hc.nBMPw * hc.nBMPh) - FILE_SIZE_PIXELS < dfs.w) return -4;
-	while(hpels)
+	ret = 0;
+
+cleanup:
+	qdone(&bc.q);
+	for(k = 0; k < nStarted; k++) pthread_join(pThreads[k], NULL);
+	if(bWriter) pthread_join(tWriter, NULL);
+	if(bc.fOut)
 	{
-		dobyte = 0;
-		if(--wpels)
+		if(ret == 0 && (bc.bFailed || fwrite(bEnd, 1, sizeof(bEnd), bc.fOut) != sizeof(bEnd))) ret = -1;
+		if(fclose(bc.fOut)) ret = -1;
+		if(ret)
 		{
-			// more pixels in the current scan line
-			pC += 3;
-			dobyte |= *pC & 0x7;
-			dobyte |= (*(pC + 1) & 0x3) << 3;
-			dobyte |= (*(pC + 2) & 0x7) << 5;
+			if(bWriter) fprintf(stderr, "ERROR: unable to write <tar out>.\n");
+			removepath(pTarout);
 		}
-		else
+	}
+	if(bWriter) fprintf(stderr, "extracted %d of %d files: %d skipped, %d unreadable.\n", bc.nDone, bc.nDone + bc.nSkipped, bc.nSkipped, nErr);
+	free(bc.q.ppPaths);
+	free(bc.qWalk.ppPaths);
+	free(bc.ppSorted);
+	free(bc.ppRing);
+	free(pThreads);
+	if(ret == 0 && (bc.nSkipped || nErr)) ret = 1;
+
+	return ret;
+}
+
+void *bigalloc(size_t n)
+{
+	// buffers read out of order.  With --hugepages they are mapped from
+	// the reserved huge page pool, or else aligned to a huge page and
+	// offered to the kernel for transparent ones.  The mapping length is
+	// kept in the HUGE_HDR bytes in front for bigfree().
+	uint8_t *p, *a;
+	size_t k;
+
+	if(!opts.bHuge) return malloc(n);
+	k = (n + HUGE_HDR + HUGE_PAGE - 1) & ~(size_t)(HUGE_PAGE - 1);
+	if((p = (uint8_t *)mmap(NULL, k, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0)) == MAP_FAILED)
+	{
+		if((p = (uint8_t *)mmap(NULL, k + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) return NULL;
+		a = (uint8_t *)(((uintptr_t)p + HUGE_PAGE - 1) & ~(uintptr_t)(HUGE_PAGE - 1));
+		if(a > p) munmap(p, a - p);
+		munmap(a + k, p + HUGE_PAGE - a);
+		p = a;
+		madvise(p, k, MADV_HUGEPAGE);
+	}
+	*(size_t *)p = k;
+	__atomic_fetch_add(&qwHugebytes, k, __ATOMIC_RELAXED);
+
+	return p + HUGE_HDR;
+}
+
+void bigfree(void *p)
+{
+	if(p == NULL) return;
+	if(!opts.bHuge)
+	{
+		free(p);
+
+		return;
+	}
+	p = (uint8_t *)p - HUGE_HDR;
+	munmap(p, *(size_t *)p);
+}
+
+int pininit(void)
+{
+	// lists the cpus this process may run on so that consecutive workers
+	// take NUMA nodes in turn, from the nodeN links in sysfs.  A cpu
+	// without one counts as node 0.
+	char szPath[64];
+	struct dirent *de;
+	cpu_set_t set;
+	int *pCpu = NULL, *pNode = NULL, nCpus = 0, nNodes = 1, i, j, k, r, ret = -1;
+	DIR *d;
+
+	if(sched_getaffinity(0, sizeof(set), &set)) return -1;
+	k = CPU_COUNT(&set);
+	if((pCpu = (int *)malloc(k * sizeof(int))) == NULL || (pNode = (int *)malloc(k * sizeof(int))) == NULL || (pPincpus = (int *)malloc(k * sizeof(int))) == NULL) goto cleanup;
+	for(i = 0; i < CPU_SETSIZE && nCpus < k; i++)
+	{
+		if(!CPU_ISSET(i, &set)) continue;
+		pCpu[nCpus] = i;
+		pNode[nCpus] = 0;
+		snprintf(szPath, sizeof(szPath), "/sys/devices/system/cpu/cpu%d", i);
+		if((d = opendir(szPath)) != NULL)
 		{
-			// read new scan line.
-			if(--hpels == 0) return -5;
-			wpels = hc.nBMPw;
-			pC = pBMPbufin;
-			if(fread(pBMPbufin, 1, hc.nStride, fBMPin) != hc.nStride) return -6;
-			dobyte |= *pC & 0x7;
-			dobyte |= (*(pC + 1) & 0x3) << 3;
-			dobyte |= (*(pC + 2) & 0x7) << 5;
+			while((de = readdir(d)) != NULL)
+			{
+				if(!strncmp(de->d_name, "node", 4) && isdigit((unsigned char)de->d_name[4])) pNode[nCpus] = atoi(de->d_name + 4);
+			}
+			closedir(d);
+		}
+		if(pNode[nCpus] >= nNodes) nNodes = pNode[nCpus] + 1;
+		nCpus++;
+	}
+	// round r takes the r-th cpu of each node.
+	for(r = 0; nPincpus < nCpus; r++)
+	{
+		for(k = 0; k < nNodes; k++)
+		{
+			for(i = 0, j = 0; i < nCpus; i++)
+			{
+				if(pNode[i] == k && j++ == r)
+				{
+					pPincpus[nPincpus++] = pCpu[i];
+					break;
+				}
+			}
 		}
-		if(fwrite(&dobyte, 1, 1, fFileout) != 1) return -7;
-		if(--dfs.w == 0) break;
 	}
+	ret = nPincpus ? 0 : -1;
+
+cleanup:
+	free(pCpu);
+	free(pNode);
+
+	return ret;
+}
+
+void pinworker(void)
+{
+	// with --pin, binds the calling thread to the next cpu from pininit().
+	// Pages are placed on the node of the thread that first touches them,
+	// so the buffers and band blocks a worker allocates stay local.
+	cpu_set_t set;
+	int k;
+
+	if(nPincpus == 0) return;
+	k = __atomic_fetch_add(&nPinnext, 1, __ATOMIC_RELAXED) % nPincpus;
+	CPU_ZERO(&set);
+	CPU_SET(pPincpus[k], &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+void ckptid(PCHECKPOINT pc, int nPart, struct stat *st)
+{
+	// device, inode, size and mtime of <bmp in> (nPart 0) or <data in>
+	// (nPart 1), 8 bytes each after the mode and 3 zeros.
+	uint64_t qwId[5];
+	int i;
+
+	qwId[0] = st->st_dev;
+	qwId[1] = st->st_ino;
+	qwId[2] = st->st_size;
+	qwId[3] = st->st_mtim.tv_sec;
+	qwId[4] = st->st_mtim.tv_nsec;
+	for(i = 0; i < 5; i++) putle(pc->bId + 4 + (nPart * 40) + (i * 8), qwId[i], 8);
+}
+
+int ckptload(PCHECKPOINT pc)
+{
+	// reads the checkpoint when there is a whole one for the inputs and
+	// mode in pc->bId.
+	uint8_t p[CKPT_LEN];
+	ssize_t n;
+	int fd;
+
+	if((fd = open(pc->szPath, O_RDONLY | O_CLOEXEC)) < 0) return -1;
+	n = pread(fd, p, sizeof(p), 0);
+	close(fd);
+	if(n != sizeof(p) || memcmp(p, "BSK1", 4) || (uint32_t)getle(p + 144, 4) != crc32c(0, p, 144) || memcmp(p + 4, pc->bId, CKPT_ID)) return -1;
+	pc->wFlags = (uint16_t)getle(p + 88, 2);
+	pc->bDone = p[90];
+	memcpy(pc->bNonce, p + 92, EXT_NONCE_LEN);
+	pc->nRow = (int)getle(p + 104, 4);
+	pc->qwPos = getle(p + 108, 8);
+	pc->dwCRC = (uint32_t)getle(p + 116, 4);
+	pc->qwGen = getle(p + 120, 8);
+	pc->qwBlock = getle(p + 128, 8);
+	pc->dwBlock = (uint32_t)getle(p + 136, 4);
+	pc->dwBlockcrc = (uint32_t)getle(p + 140, 4);
+
+	return 0;
+}
+
+int ckptsave(PCHECKPOINT pc)
+{
+	// flushes the output to disk, then replaces the checkpoint:
+	//  magic "BSK1", the mode and input identities, see ckptid().
+	//  extended header flags 2 bytes, bDone 1, a zero, the nonce.
+	//  scan lines 4, stream position 8, crc32c 4, generator state 8.
+	//  the block written since the last checkpoint, output offset 8,
+	//  length 4 and crc32c 4.
+	//  crc32c of all of the above, 4 bytes.
+	// The file is written under a temporary name and renamed, so a run
+	// killed at any point leaves a whole checkpoint the output covers.
+	uint8_t p[CKPT_LEN];
+	char szTmp[sizeof(pc->szPath) + 8];
+	int fd, ret = -1;
+
+	if(fflush(pc->fOut) || fdatasync(fileno(pc->fOut))) return -1;
+	memset(p, 0, sizeof(p));
+	memcpy(p, "BSK1", 4);
+	memcpy(p + 4, pc->bId, CKPT_ID);
+	putle(p + 88, pc->wFlags, 2);
+	p[90] = (uint8_t)pc->bDone;
+	memcpy(p + 92, pc->bNonce, EXT_NONCE_LEN);
+	putle(p + 104, pc->nRow, 4);
+	putle(p + 108, pc->qwPos, 8);
+	putle(p + 116, pc->dwCRC, 4);
+	putle(p + 120, pc->qwGen, 8);
+	putle(p + 128, pc->qwBlock, 8);
+	putle(p + 136, pc->dwBlock, 4);
+	putle(p + 140, pc->dwBlockcrc, 4);
+	putle(p + 144, crc32c(0, p, 144), 4);
+	snprintf(szTmp, sizeof(szTmp), "%s.tmp", pc->szPath);
+	if((fd = open(szTmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) return -1;
+	if(pwrite(fd, p, sizeof(p), 0) == sizeof(p) && fdatasync(fd) == 0 && rename(szTmp, pc->szPath) == 0) ret = 0;
+	close(fd);
+	if(ret)
+	{
+		unlink(szTmp);
+
+		return -1;
+	}
+	pc->bSaved = 1;
+	pc->qwBlock += pc->dwBlock;
+	pc->dwBlock = 0;
+	pc->dwBlockcrc = 0;
+
+	return 0;
+}
+
+int ckptcheck(PCHECKPOINT pc, FILE *f, uint64_t qwEnd)
+{
+	// the last block of a loaded checkpoint must still be in the output
+	// as written and end at qwEnd, where the run picks up.  Leaves f
+	// there with the next block starting.
+	uint8_t buf[BUF_SIZE];
+	uint32_t dwCRC = 0, dwLeft = pc->dwBlock;
+	int k;
+
+	if(pc->dwBlock == 0 || pc->qwBlock + pc->dwBlock != qwEnd || fseeko(f, (off_t)pc->qwBlock, SEEK_SET)) return -1;
+	while(dwLeft)
+	{
+		k = dwLeft < BUF_SIZE ? dwLeft : BUF_SIZE;
+		if(fread(buf, 1, k, f) != k) return -1;
+		dwCRC = crc32c(dwCRC, buf, k);
+		dwLeft -= k;
+	}
+	// a switch from reading to writing needs a seek.
+	if(dwCRC != pc->dwBlockcrc || fseeko(f, (off_t)qwEnd, SEEK_SET)) return -1;
+	pc->qwBlock = qwEnd;
+	pc->dwBlock = 0;
+	pc->dwBlockcrc = 0;
+
+	return 0;
+}
+
+int ckptsrc(PCHECKPOINT pc, PDATASRC ds)
+{
+	// moves a fresh payload stream of one member, with no compression,
+	// parity or placement stage, to where the checkpoint left it.  The
+	// cipher is keyed by body offset and needs no state.
+	PMEMBER pm = ds->pMembers;
+	uint64_t qwData = pc->qwPos > (uint64_t)ds->nPrefix ? pc->qwPos - ds->nPrefix : 0;
+
+	if(ds->nMembers != 1 || pc->nRow < 0 || qwData > pm->dwLength || fseeko(pm->fIn, (off_t)qwData, SEEK_SET)) return -1;
+	ds->qwPos = pc->qwPos;
+	ds->nPos = pc->qwPos < (uint64_t)ds->nPrefix ? (int)pc->qwPos : ds->nPrefix;
+	ds->qwBody = pc->qwPos > (uint64_t)ds->nHdr ? pc->qwPos - ds->nHdr : 0;
+	ds->qwCoded = ds->qwBody;
+	ds->dwLeft = pm->dwLength - (uint32_t)qwData;
+	pm->dwCRC = pc->dwCRC;
+	if(ds->pGen) ds->pGen->qwState = pc->qwGen;
+	ds->nRow0 = pc->nRow;
 
 	return 0;
 }
 
+int ckptrow(PDATASRC ds, uint8_t *p, int n, int nRow, int bDone)
+{
+	// adds a scan line written by encode() to the block, saving a
+	// checkpoint after nRow scan lines once the block is CKPT_BYTES.
+	PCHECKPOINT pc = ds->pCkpt;
+
+	pc->dwBlockcrc = crc32c(pc->dwBlockcrc, p, n);
+	pc->dwBlock += n;
+	if(pc->dwBlock < CKPT_BYTES) return 0;
+	pc->nRow = nRow;
+	pc->qwPos = ds->qwPos;
+	pc->dwCRC = ds->pMembers[0].dwCRC;
+	pc->bDone = bDone;
+	pc->qwGen = ds->pGen ? ds->pGen->qwState : 0;
+
+	return ckptsave(pc);
+}
+
+int ckptdata(PCHECKPOINT pc, uint8_t *p, int n, uint32_t dwCRC)
+{
+	// adds bytes written by pxcopy() to the block, as ckptrow() does,
+	// dwCRC of all of <data out> so far.
+	pc->dwBlockcrc = crc32c(pc->dwBlockcrc, p, n);
+	pc->dwBlock += n;
+	pc->qwPos += n;
+	pc->dwCRC = dwCRC;
+
+	return pc->dwBlock < CKPT_BYTES ? 0 : ckptsave(pc);
+}